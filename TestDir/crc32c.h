@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <nmmintrin.h>
+    #define CRC32C_X86 1
+#endif
+
+// CRC32C (Castagnoli), the checksum of iSCSI and SCTP, shared by node-announcer
+// (--crc appends it to every stream datagram) and node-receiver (verifies it).
+// crc32c() uses the SSE4.2 crc32 instruction when the CPU has it and a
+// slicing-by-8 table otherwise; both give identical results. Pass the previous
+// result as `crc` to continue a checksum across buffers.
+
+#define CRC32C_SIZE 4 // trailer bytes, little endian, after everything else in the datagram
+
+namespace crc32c_detail {
+
+constexpr uint32_t POLYNOMIAL = 0x82F63B78; // reflected Castagnoli polynomial
+
+struct Tables {
+    uint32_t t[8][256];
+
+    Tables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ (POLYNOMIAL & (0u - (crc & 1)));
+            t[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int k = 1; k < 8; ++k) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+        }
+    }
+};
+
+inline const Tables& tables() {
+    static const Tables instance;
+    return instance;
+}
+
+} // namespace crc32c_detail
+
+inline uint32_t crc32cSoftware(const void* data, size_t size, uint32_t crc = 0) {
+    const uint32_t (*t)[256] = crc32c_detail::tables().t;
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    for (; size >= 8; p += 8, size -= 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+    for (; size; ++p, --size) crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+    return ~crc;
+}
+
+#ifdef CRC32C_X86
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("sse4.2")))
+#endif
+inline uint32_t crc32cHardware(const void* data, size_t size, uint32_t crc = 0) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t state = ~crc;
+    for (; size >= 8; p += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        state = _mm_crc32_u64(state, word);
+    }
+    uint32_t tail = (uint32_t)state;
+    for (; size; ++p, --size) tail = _mm_crc32_u8(tail, *p);
+    return ~tail;
+}
+
+inline bool crc32cAccelerated() {
+#if defined(__GNUC__) || defined(__clang__)
+    static const bool available = __builtin_cpu_supports("sse4.2");
+#else
+    static const bool available = true; // every x64 CPU Windows still supports has SSE4.2
+#endif
+    return available;
+}
+
+inline uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0) {
+    return crc32cAccelerated() ? crc32cHardware(data, size, crc) : crc32cSoftware(data, size, crc);
+}
+
+#else
+
+inline bool crc32cAccelerated() { return false; }
+
+inline uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0) {
+    return crc32cSoftware(data, size, crc);
+}
+
+#endif
+
+// Appends the checksum of datagram[0, size) and returns the new size.
+inline size_t appendCrc32c(char* datagram, size_t size) {
+    uint32_t crc = crc32c(datagram, size);
+    std::memcpy(datagram + size, &crc, CRC32C_SIZE);
+    return size + CRC32C_SIZE;
+}
+
+// True when the datagram ends in a matching trailer.
+inline bool checkCrc32c(const char* datagram, size_t size) {
+    if (size < CRC32C_SIZE) return false;
+    uint32_t stored;
+    std::memcpy(&stored, datagram + size - CRC32C_SIZE, CRC32C_SIZE);
+    return crc32c(datagram, size - CRC32C_SIZE) == stored;
+}
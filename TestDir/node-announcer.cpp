@@ -8,10 +8,24 @@
 #include <bitset>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <deque>
+#include <memory>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <limits>
+
+#include "crc32c.h"
+#include "node-shm.h"
 
 #ifdef _WIN32
     #include <winsock2.h>
     #include <ws2tcpip.h>
+    #include <sys/stat.h>
     #pragma comment(lib, "ws2_32.lib")
     typedef int socklen_t;
 #else
@@ -19,6 +33,21 @@
     #include <netinet/in.h>
     #include <arpa/inet.h>
     #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/resource.h>
+    #include <sys/wait.h>
+    #include <sys/uio.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+#endif
+#ifdef __linux__
+    #include <sys/epoll.h>
+    #include <sys/inotify.h>
+    #include <poll.h>
+    #include <sched.h>
+#endif
+#ifndef _WIN32
     #define SOCKET int
     #define INVALID_SOCKET -1
     #define SOCKET_ERROR -1
@@ -28,6 +57,48 @@
 #define NUM_NODES 20
 #define MIN_EDGES 6
 #define MAX_EDGES 35 // set max edges in packet to 50
+#define ROUTING_QUERIES 1000000 // synthetic route queries per routing tick
+#define ROUTING_TICK_MS 1000
+#define ENDPOINT_BASE_PORT 40000 // source port of virtual endpoints
+#define CLOCK_SYNC_PORT 12347
+#define CLOCK_SYNC_MAGIC 0x534B4C43 // "CLKS"
+#define SWEEP_BASE_PORT 13000 // each sweep run sends to its own pair of ports
+#define EDGE_LIFETIME_TICKS 20 // mean lifetime of an evolving edge, in graph rounds
+#define EDGE_DRIFT_TICKS 4     // mean rounds between strength changes of an evolving edge
+#define EDGE_DRIFT_STEP 50     // largest strength change per drift
+#define CONTROL_PORT 12348
+#define TRAIL_QUERY_MAGIC 0x4C415254 // "TRAL"
+#define HISTORY_LENGTH 128 // position ticks kept per node for trail queries
+#define MAX_HISTORY_LENGTH 4000 // keeps a full trail reply inside one UDP datagram
+#define SPATIAL_QUERY_PORT 12349
+#define SPATIAL_QUERY_MAGIC 0x59515053 // "SPQY"
+#define WORLD_SIZE 1000.0f // positions stay within [0, WORLD_SIZE] on both axes
+#define REPLY_MTU 1472 // largest UDP payload that is not fragmented on Ethernet
+#define QUERY_BATCH 64 // spatial queries received per system call
+#define SPHERE_COVER_CELLS 8 // cells used to cover the region of a sphere query
+#define MOVE_DISTANCE 5.0f // largest position change per axis per tick
+#define POSITION_INTERVAL_MS 100
+#define POSITION_SPACING_MS 10 // between nodes within a position round
+#define GRAPH_INTERVAL_MS 2000
+#define GRAPH_SPACING_MS 200 // between senders within a graph round
+#define SCENARIO_BASE_PORT 14000 // hosted scenarios default to their own pair of ports from here
+#define SCENARIO_REPORT_S 10
+#define SEND_RATE_MAX 1000000 // datagrams per second per socket, the AIMD ceiling and starting rate
+#define SEND_RATE_MIN 1000
+#define SEND_RATE_STEP 10000 // additive increase per interval without pushback
+#define SEND_RATE_INTERVAL_MS 10
+#define RATE_BURST_MS 100 // default depth of a rate cap, in time at its rate
+#define MAX_SEND_RATE 10e9 // bytes per second, the largest configurable cap
+#define WATCHDOG_OVERRUN_TICKS 3   // overrunning position ticks in a row before shedding a step
+#define WATCHDOG_RECOVER_TICKS 20  // ticks with headroom in a row before restoring one
+#define WATCHDOG_HEADROOM 0.5      // share of the tick budget below which a tick has headroom
+#define REFRESH_EVERY 4 // while shedding, unchanged positions go out every this many ticks
+#define INTEREST_MAGIC 0x544E4947 // "GINT"
+#define INTEREST_MAX_SENDERS 512  // sender ids in one interest request
+#define INTEREST_MAX_LEASE_MS 60000
+#define GRAPH_KEYFRAME_ROUNDS 10 // with --lazy-graphs, every sender still goes out once per this many rounds
+#define LOCAL_SOCKET_DIR "/tmp" // --unix streams live at <dir>/node-positions.sock and <dir>/node-graphs.sock
+#define LOCAL_SEND_WAIT_MS 10 // longest a --unix batch waits for slow receivers
 
 struct PositionPacket {
     uint16_t node_id;
@@ -48,13 +119,534 @@ struct GraphPacket {
     GraphEdge edges[50];
 };
 
+// Side-channel clock sync exchange, NTP style: the receiver fills t1 with its own
+// clock, the announcer answers with t2 (request received) and t3 (reply sent) on
+// its clock. All times are nanoseconds.
+struct ClockSyncPacket {
+    uint32_t magic;
+    uint32_t seq;
+    int64_t t1;
+    int64_t t2;
+    int64_t t3;
+};
+
+// Trail query on the control port: the last window_ms of positions of one node
+// (0 = everything kept).
+struct TrailQuery {
+    uint32_t magic;
+    uint16_t node_id;
+    uint16_t reserved;
+    uint32_t window_ms;
+};
+
+// Trail reply: this header, then count int64 record times (announcer clock, ns),
+// then count float x, y pairs, oldest first. count is 0 for unknown nodes.
+struct TrailReplyHeader {
+    uint32_t magic;
+    uint16_t node_id;
+    uint16_t count;
+    int64_t now;
+};
+
+enum InterestKind : uint8_t {
+    INTEREST_SENDERS = 0, // the count sender ids that follow the request
+    INTEREST_AREA = 1,    // senders within radius of (x, y)
+};
+
+// Graph interest on the control port: the requesting address wants the graphs
+// of these senders until lease_ms passes without a renewal (0 drops it). With
+// --lazy-graphs only wanted senders and due keyframes are generated. A new
+// request from the same address replaces the old one.
+struct InterestRequest {
+    uint32_t magic;
+    uint8_t kind;
+    uint8_t reserved;
+    uint16_t count;
+    uint32_t lease_ms;
+    float x;
+    float y;
+    float radius;
+    // then count uint16 sender ids for INTEREST_SENDERS
+};
+
+enum SpatialQueryKind : uint8_t {
+    QUERY_RANGE = 0,   // nodes within radius a of (x, y)
+    QUERY_NEAREST = 1, // k nodes nearest to (x, y), closest first
+    QUERY_BOX = 2,     // nodes inside [x, a] x [y, b]
+    // On the sphere, in degrees, with the world mapped equirectangularly like the
+    // listener's DIS view (x spans longitude, y latitude). Results carry lat, lon.
+    QUERY_CAP = 3,     // nodes within angle a of (lat x, lon y)
+    QUERY_RECT = 4,    // nodes with lat in [x, a] and lon in [y, b]; y > b wraps the antimeridian
+    QUERY_INBOUND = 5, // edges into node k in the last published graphs, as InboundEdge results
+};
+
+// Spatial query on the spatial query port. request_id is echoed in every reply chunk.
+struct SpatialQuery {
+    uint32_t magic;
+    uint32_t request_id;
+    uint8_t kind;
+    uint8_t reserved;
+    uint16_t k;
+    float x;
+    float y;
+    float a;
+    float b;
+};
+
+// Each reply chunk is this header followed by count results packed like position
+// packets (node_id, x, y; 10 bytes). A reply is split into as many chunks as
+// needed to keep every datagram within REPLY_MTU.
+struct SpatialReplyHeader {
+    uint32_t magic;
+    uint32_t request_id;
+    uint16_t chunk;
+    uint16_t chunks;
+    uint16_t count;
+    uint16_t total; // results over all chunks
+};
+
+// Result of an inbound query: an edge into the queried node and the sender whose
+// graph carries it.
+struct InboundEdge {
+    uint16_t sender_id;
+    uint16_t source_id;
+    uint16_t strength;
+};
+
+constexpr size_t SPATIAL_RESULT_SIZE = sizeof(uint16_t) + 2 * sizeof(float);
+constexpr size_t RESULTS_PER_CHUNK = (REPLY_MTU - sizeof(SpatialReplyHeader)) / SPATIAL_RESULT_SIZE;
+constexpr size_t INBOUND_PER_CHUNK = (REPLY_MTU - sizeof(SpatialReplyHeader)) / sizeof(InboundEdge);
+
+// Room for the packet plus optional trailers appended after the payload.
+constexpr size_t MAX_DATAGRAM_SIZE = sizeof(GraphPacket) + 16;
+
 std::atomic<bool> running{true};
 std::mutex lock;
 
-class UDPServer {
+enum class EndpointMode { None, Address, Port };
+enum class GraphModel { Random, Evolving };
+enum class LocalSocketType { None, Datagram, SeqPacket };
+
+struct Options {
+    int num_nodes = NUM_NODES;
+    uint64_t routing_queries = 0;
+    EndpointMode endpoints = EndpointMode::None;
+    bool timestamps = false; // append the announcer send time to every datagram
+    bool crc = false;        // then a CRC32C of everything before it
+    GraphModel graph_model = GraphModel::Random;
+    size_t history_length = HISTORY_LENGTH;
+    bool fixed_point = false; // deterministic integer positions from fixed_seed
+    uint64_t fixed_seed = 1;
+    std::string checkpoint_path; // periodic checkpoints, plus one at shutdown
+    double checkpoint_interval = 60;
+    std::string restore_path;
+    std::string config_path; // runtime settings, reloaded whenever the file changes
+    int lazy_keyframe_rounds = 0; // non-zero: generate graphs on demand, see GraphInterest
+    std::string shm_name;         // also publish to same-host readers through this shm region
+    LocalSocketType local_socket = LocalSocketType::None; // AF_UNIX sockets instead of UDP
+    std::string local_socket_dir = LOCAL_SOCKET_DIR;
+};
+
+// A fan-out target of the streams and its own rate cap in bytes per second.
+struct Destination {
+    std::string host;
+    uint64_t rate;
+};
+
+// Settings that can be retuned while the announcer runs. The servers pick up a
+// new version at their next tick boundary, so a reload never costs a tick.
+struct RuntimeConfig {
+    int position_interval_ms = POSITION_INTERVAL_MS;
+    int position_spacing_ms = POSITION_SPACING_MS;
+    int graph_interval_ms = GRAPH_INTERVAL_MS;
+    int graph_spacing_ms = GRAPH_SPACING_MS;
+    int min_edges = MIN_EDGES;
+    int max_edges = MAX_EDGES;
+    float move_distance = MOVE_DISTANCE;
+    int send_buffer = 0; // SO_SNDBUF bytes for the stream sockets, 0 for the system default
+    std::vector<Destination> destinations{{"127.0.0.1", 0}}; // every stream is sent to each host
+    // Byte rate caps (0 for none): all streams together, each stream, each
+    // destination unless it names its own as host@rate.
+    uint64_t global_rate = 0;
+    uint64_t position_rate = 0;
+    uint64_t graph_rate = 0;
+    uint64_t subscriber_rate = 0;
+    int rate_burst_ms = RATE_BURST_MS;
+    // High priority traffic over a cap waits for its turn, low priority is dropped.
+    bool position_high_priority = true;
+    bool graph_high_priority = false;
+};
+
+// Reads `key = value` lines ('#' starts a comment) over the defaults and checks
+// every value, throwing on the first problem so a bad edit never goes live.
+std::shared_ptr<const RuntimeConfig> loadRuntimeConfig(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("cannot open " + path);
+    auto config = std::make_shared<RuntimeConfig>();
+    bool destinations_set = false;
+    std::vector<bool> own_rate; // per destination, host@rate given
+    std::string line;
+    for (int line_number = 1; std::getline(in, line); ++line_number) {
+        line = line.substr(0, line.find('#'));
+        size_t equals = line.find('=');
+        auto trim = [](std::string text) {
+            size_t first = text.find_first_not_of(" \t\r");
+            size_t last = text.find_last_not_of(" \t\r");
+            return first == std::string::npos ? std::string() : text.substr(first, last - first + 1);
+        };
+        std::string key = trim(line.substr(0, equals));
+        if (key.empty()) continue;
+        std::string where = path + ":" + std::to_string(line_number) + ": ";
+        if (equals == std::string::npos) throw std::runtime_error(where + "expected key = value");
+        std::string value = trim(line.substr(equals + 1));
+        auto parseNumber = [&](const std::string& text, double lo, double hi) {
+            size_t used = 0;
+            double parsed = 0;
+            try {
+                parsed = std::stod(text, &used);
+            } catch (const std::exception&) {
+                used = 0;
+            }
+            if (used == 0 || used != text.size() || !(parsed >= lo && parsed <= hi)) {
+                throw std::runtime_error(where + key + " must be a number in [" + std::to_string((long long)lo) + ", " + std::to_string((long long)hi) + "]");
+            }
+            return parsed;
+        };
+        auto number = [&](double lo, double hi) { return parseNumber(value, lo, hi); };
+        auto priority = [&]() {
+            if (value != "high" && value != "low") throw std::runtime_error(where + key + " must be high or low");
+            return value == "high";
+        };
+        if (key == "position_interval_ms") config->position_interval_ms = (int)number(1, 60000);
+        else if (key == "position_spacing_ms") config->position_spacing_ms = (int)number(0, 60000);
+        else if (key == "graph_interval_ms") config->graph_interval_ms = (int)number(1, 600000);
+        else if (key == "graph_spacing_ms") config->graph_spacing_ms = (int)number(0, 60000);
+        else if (key == "min_edges") config->min_edges = (int)number(0, 50);
+        else if (key == "max_edges") config->max_edges = (int)number(0, 50);
+        else if (key == "move_distance") config->move_distance = (float)number(0, WORLD_SIZE);
+        else if (key == "send_buffer") config->send_buffer = (int)number(0, 64 << 20);
+        else if (key == "global_rate") config->global_rate = (uint64_t)number(0, MAX_SEND_RATE);
+        else if (key == "position_rate") config->position_rate = (uint64_t)number(0, MAX_SEND_RATE);
+        else if (key == "graph_rate") config->graph_rate = (uint64_t)number(0, MAX_SEND_RATE);
+        else if (key == "subscriber_rate") config->subscriber_rate = (uint64_t)number(0, MAX_SEND_RATE);
+        else if (key == "rate_burst_ms") config->rate_burst_ms = (int)number(1, 10000);
+        else if (key == "position_priority") config->position_high_priority = priority();
+        else if (key == "graph_priority") config->graph_high_priority = priority();
+        else if (key == "destinations") {
+            if (!destinations_set) config->destinations.clear();
+            destinations_set = true;
+            std::istringstream hosts(value);
+            for (std::string host; std::getline(hosts, host, ',');) {
+                host = trim(host);
+                size_t at = host.find('@');
+                uint64_t rate = at == std::string::npos ? 0 : (uint64_t)parseNumber(trim(host.substr(at + 1)), 1, MAX_SEND_RATE);
+                host = trim(host.substr(0, at));
+                in_addr address;
+                if (inet_pton(AF_INET, host.c_str(), &address) != 1) throw std::runtime_error(where + "bad destination address '" + host + "'");
+                config->destinations.push_back({host, rate});
+                own_rate.push_back(at != std::string::npos);
+            }
+        } else {
+            throw std::runtime_error(where + "unknown setting '" + key + "'");
+        }
+    }
+    if (config->max_edges < config->min_edges) throw std::runtime_error(path + ": max_edges is below min_edges");
+    if (config->destinations.empty()) throw std::runtime_error(path + ": no destinations");
+    for (size_t i = 0; i < config->destinations.size(); ++i) {
+        if (i >= own_rate.size() || !own_rate[i]) config->destinations[i].rate = config->subscriber_rate;
+    }
+    return config;
+}
+
+// The version the servers run with; replaced whole, never modified in place.
+std::shared_ptr<const RuntimeConfig> runtime_config = std::make_shared<const RuntimeConfig>();
+
+std::shared_ptr<const RuntimeConfig> currentConfig() {
+    return std::atomic_load(&runtime_config);
+}
+
+// Time base shared with receivers through the clock sync exchange.
+int64_t announcerClockNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Appends the send timestamp trailer (int64 ns, announcer clock) after a payload.
+size_t appendTimestamp(char* datagram, size_t size) {
+    int64_t now = announcerClockNs();
+    std::memcpy(datagram + size, &now, sizeof(now));
+    return size + sizeof(now);
+}
+
+// Stream datagrams end in the optional trailers: send timestamp, then CRC32C.
+size_t appendTrailers(const Options& options, char* datagram, size_t size) {
+    if (options.timestamps) size = appendTimestamp(datagram, size);
+    if (options.crc) size = appendCrc32c(datagram, size);
+    return size;
+}
+
+// Position updates go out as node_id, x, y with no padding (10 bytes).
+size_t packPosition(uint16_t node_id, std::pair<float, float> pos, char* out) {
+    std::memcpy(out, &node_id, sizeof(uint16_t));
+    std::memcpy(out + 2, &pos.first, sizeof(float));
+    std::memcpy(out + 6, &pos.second, sizeof(float));
+    return sizeof(uint16_t) + 2 * sizeof(float);
+}
+
+size_t graphPacketSize(const GraphPacket& packet) {
+    return sizeof(GraphPacket) - sizeof(GraphEdge) * (50 - packet.edge_count);
+}
+
+// True when the last socket call failed because the kernel pushed back (full
+// socket buffer or no buffer memory) rather than for good.
+inline bool sendWouldBlock() {
+#ifdef _WIN32
+    int error = WSAGetLastError();
+    return error == WSAEWOULDBLOCK || error == WSAENOBUFS;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS;
+#endif
+}
+
+// AIMD pacing for one socket. Until the kernel first pushes back every send is
+// admitted; from then on sends are admitted from a token bucket filled at
+// `rate` datagrams per second. Every SEND_RATE_INTERVAL_MS without kernel
+// pushback adds SEND_RATE_STEP to the rate; pushback halves it, at most once
+// per interval so one full buffer is not punished many times over. Back at
+// SEND_RATE_MAX the pacing is off again.
+class AimdRate {
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr std::chrono::milliseconds INTERVAL{SEND_RATE_INTERVAL_MS};
+
+    double rate = SEND_RATE_MAX;
+    double tokens = SEND_RATE_MAX * (double)SEND_RATE_INTERVAL_MS / 1000; // one full burst
+    Clock::time_point last_refill = Clock::now();
+    Clock::time_point last_change = Clock::now();
+    bool pushed_back = false; // since the last change
+    bool throttled = false;   // since a pushback, until the rate is back at the ceiling
+
+    void adjust(Clock::time_point now) {
+        if (now - last_change < INTERVAL) return;
+        if (!pushed_back) rate = std::min<double>(SEND_RATE_MAX, rate + SEND_RATE_STEP);
+        if (rate >= SEND_RATE_MAX) throttled = false;
+        pushed_back = false;
+        last_change = now;
+    }
+
+public:
+    uint64_t backoffs = 0;
+
+    // Takes one token if the current rate allows another datagram now.
+    bool admit() {
+        if (!throttled) return true;
+        Clock::time_point now = Clock::now();
+        adjust(now);
+        double burst = std::max(64.0, rate * INTERVAL.count() / 1000.0);
+        tokens = std::min(burst, tokens + rate * std::chrono::duration<double>(now - last_refill).count());
+        last_refill = now;
+        if (tokens < 1) return false;
+        tokens -= 1;
+        return true;
+    }
+
+    void pushback() {
+        if (pushed_back) return;
+        rate = std::max<double>(SEND_RATE_MIN, rate / 2);
+        tokens = 0;
+        pushed_back = true;
+        throttled = true;
+        last_refill = Clock::now();
+        last_change = Clock::now();
+        backoffs++;
+    }
+
+    double current() const { return rate; }
+};
+
+struct SendStats {
+    uint64_t sent = 0;
+    uint64_t deferred = 0;       // queued on pushback or pacing, sent later
+    uint64_t dropped = 0;        // a hard send error or a removed destination's queue
+    uint64_t overflowed = 0;     // retry queue overflow, oldest dropped
+    uint64_t limit_deferred = 0; // high priority over a rate cap, queued
+    uint64_t limit_dropped = 0;  // low priority over a rate cap
+    uint64_t backoffs = 0;
+    double rate = 0;             // current AIMD rate, datagrams per second
+};
+
+// Byte rate cap in GCRA form: rather than a token count it keeps the time at
+// which the bucket is full again, so admitting a datagram costs a multiply, an
+// add and a compare on integer nanoseconds. The bucket holds burst_ms of
+// traffic, and always at least one datagram.
+class TokenBucket {
+private:
+    uint64_t ns_per_byte = 0; // 16 fractional bits; 0 means no cap
+    int64_t burst_ns = 0;
+    int64_t full_at = 0;      // announcer clock
+
+public:
+    void setRate(uint64_t bytes_per_s, int burst_ms) {
+        ns_per_byte = bytes_per_s ? (1000000000ull << 16) / bytes_per_s : 0;
+        burst_ns = std::max<int64_t>(burst_ms * 1000000ll, cost(MAX_DATAGRAM_SIZE));
+    }
+
+    int64_t cost(size_t bytes) const { return (int64_t)((bytes * ns_per_byte) >> 16); }
+
+    bool fits(int64_t now, size_t bytes) const {
+        return !ns_per_byte || std::max(full_at, now) + cost(bytes) - now <= burst_ns;
+    }
+
+    void charge(int64_t now, size_t bytes) {
+        if (ns_per_byte) full_at = std::max(full_at, now) + cost(bytes);
+    }
+};
+
+// The same cap shared by every sending thread, charged with one compare-and-swap.
+class SharedTokenBucket {
+private:
+    std::atomic<uint64_t> ns_per_byte{0};
+    std::atomic<int64_t> burst_ns{0};
+    std::atomic<int64_t> full_at{0};
+
+public:
+    void setRate(uint64_t bytes_per_s, int burst_ms) {
+        uint64_t rate = bytes_per_s ? (1000000000ull << 16) / bytes_per_s : 0;
+        burst_ns = std::max<int64_t>(burst_ms * 1000000ll, (int64_t)((MAX_DATAGRAM_SIZE * rate) >> 16));
+        ns_per_byte = rate;
+    }
+
+    // Charges the datagram if it fits now.
+    bool take(int64_t now, size_t bytes) {
+        uint64_t rate = ns_per_byte.load(std::memory_order_relaxed);
+        if (!rate) return true;
+        int64_t cost = (int64_t)((bytes * rate) >> 16), burst = burst_ns.load(std::memory_order_relaxed);
+        int64_t seen = full_at.load(std::memory_order_relaxed), next;
+        do {
+            next = std::max(seen, now) + cost;
+            if (next - now > burst) return false;
+        } while (!full_at.compare_exchange_weak(seen, next, std::memory_order_relaxed));
+        return true;
+    }
+
+    // Gives back what take() charged for a datagram that did not go out.
+    void refund(size_t bytes) {
+        uint64_t rate = ns_per_byte.load(std::memory_order_relaxed);
+        if (rate) full_at.fetch_sub((int64_t)((bytes * rate) >> 16), std::memory_order_relaxed);
+    }
+};
+
+// Cap on all stream traffic of the process (runtime config global_rate), over
+// UDP, --endpoints and --unix alike. The shared-memory ring is not capped.
+SharedTokenBucket global_send_limit;
+
+void printSendStats(const std::string& stream, const SendStats& stats) {
+    std::cout << stream << " sent " << stats.sent << " datagrams, deferred " << stats.deferred << ", dropped " << stats.dropped
+              << ", dropped from full retry queues " << stats.overflowed << ", over rate caps deferred " << stats.limit_deferred << " and dropped " << stats.limit_dropped << ", backed off "
+              << stats.backoffs << " times, rate now " << (uint64_t)stats.rate << "/s\n";
+}
+
+struct EndpointDatagram {
+    uint16_t node_id;
+    uint16_t size;
+    char data[MAX_DATAGRAM_SIZE];
+};
+
+// Where a stream's datagrams go: UDP, virtual endpoints, unix sockets, the
+// shared-memory ring, or nothing. The backend is picked once at startup and the
+// server loops hand it whole batches, so it costs one virtual call per batch
+// rather than per datagram.
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    // Whatever cannot go out now is queued for flush() or counted as dropped.
+    virtual void sendBatch(const EndpointDatagram* batch, size_t count) = 0;
+    virtual void flush() {}
+    // A reloaded config at a tick boundary, with the stream's own byte rate cap
+    // and priority. Returns the send buffer the kernel granted, if any.
+    virtual int configure(const RuntimeConfig&, uint64_t, bool) { return 0; }
+    // Whether the config's spacing applies: only UDP sends node by node, to keep
+    // bursts inside the receivers' socket buffers.
+    virtual bool spaced() const { return false; }
+    virtual std::string name() const = 0;
+    virtual uint64_t droppedCount() const = 0;
+    virtual void report(const std::string&) const {}
+};
+
+class UDPServer : public Transport {
 private:
+    static constexpr size_t MAX_PENDING = 1024; // least retry queue per destination, oldest dropped first
+
+    struct Pending {
+        uint16_t size;
+        char data[MAX_DATAGRAM_SIZE];
+    };
+
+    // A fan-out target with its own cap and queue, so one that is over its
+    // cap holds back only its own traffic.
+    struct Subscriber {
+        sockaddr_in to;
+        uint64_t rate; // bytes per second, 0 for no cap
+        TokenBucket limit;
+        std::deque<Pending> pending;
+        bool capped = false; // the queue waits on a rate cap, not on the socket
+    };
+
+    enum class Attempt { Done, Blocked, Limited }; // Blocked: the socket pushed back
+
     SOCKET sock;
     sockaddr_in addr;
+    std::vector<Subscriber> subscribers; // addr first, then any extra fan-out hosts
+    TokenBucket stream_limit;
+    bool high_priority = true;
+    int burst_ms = RATE_BURST_MS;
+    AimdRate pacing;
+    SendStats stats;
+    size_t pending_limit = MAX_PENDING; // per destination: the last tick's datagrams, at least MAX_PENDING
+    size_t tick_datagrams = 0;          // handed to sendPacket since the last flush()
+
+    void enqueue(Subscriber& subscriber, const void* data, size_t size, uint64_t& reason) {
+        if (subscriber.pending.size() >= pending_limit) {
+            subscriber.pending.pop_front();
+            stats.overflowed++;
+        }
+        subscriber.pending.emplace_back();
+        Pending& message = subscriber.pending.back();
+        message.size = size;
+        std::memcpy(message.data, data, size);
+        reason++;
+    }
+
+    // One attempt through the caps (destination, stream, global), then the pacing
+    // and a non-blocking send. Over a cap, low priority traffic is dropped here.
+    Attempt trySend(Subscriber& subscriber, const void* data, size_t size) {
+        int64_t now = announcerClockNs();
+        if (!subscriber.limit.fits(now, size) || !stream_limit.fits(now, size)) {
+            if (high_priority) return Attempt::Limited;
+            stats.limit_dropped++;
+            return Attempt::Done;
+        }
+        if (!pacing.admit()) return Attempt::Blocked;
+        if (!global_send_limit.take(now, size)) {
+            if (high_priority) return Attempt::Limited;
+            stats.limit_dropped++;
+            return Attempt::Done;
+        }
+        if (sendto(sock, (const char*)data, size, 0, (const sockaddr*)&subscriber.to, sizeof(subscriber.to)) >= 0) {
+            subscriber.limit.charge(now, size);
+            stream_limit.charge(now, size);
+            stats.sent++;
+            return Attempt::Done;
+        }
+        // Not sent, so not charged: a retry after the pushback pays again.
+        global_send_limit.refund(size);
+        if (sendWouldBlock()) {
+            pacing.pushback();
+            return Attempt::Blocked;
+        }
+        stats.dropped++;
+        return Attempt::Done;
+    }
     
 public:
     UDPServer(int port) {
@@ -75,11 +667,22 @@ public:
         if (setsockopt(sock, SOL_SOCKET, SO_BROADCAST, (char*)&broadcast, sizeof(broadcast)) < 0) {
             throw std::runtime_error("Failed to set broadcast option");
         }
+
+        // Never block the tick on a full socket buffer; pushback goes to the retry queue
+#ifdef _WIN32
+        u_long non_blocking = 1;
+        if (ioctlsocket(sock, FIONBIO, &non_blocking) != 0) {
+#else
+        if (fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK) < 0) {
+#endif
+            throw std::runtime_error("Failed to make socket non-blocking");
+        }
         
         memset(&addr, 0, sizeof(addr));
         addr.sin_family = AF_INET;
         addr.sin_port = htons(port);
         addr.sin_addr.s_addr = inet_addr("127.0.0.1"); // Broadcast address
+        subscribers.push_back({addr, 0, TokenBucket(), {}, false});
     }
     
     ~UDPServer() {
@@ -89,198 +692,4118 @@ public:
 #endif
     }
     
-    void sendPacket(const void* data, size_t size) {
-        sendto(sock, (const char*)data, size, 0, (sockaddr*)&addr, sizeof(addr));
+    // Sends to every host on this server's port; the hosts are validated
+    // addresses from the runtime config. Hosts that stay keep their queue and
+    // cap state; the queues of removed hosts count as dropped.
+    void setDestinations(const std::vector<Destination>& destinations) {
+        std::vector<Subscriber> next;
+        for (const Destination& destination : destinations) {
+            sockaddr_in to = addr;
+            inet_pton(AF_INET, destination.host.c_str(), &to.sin_addr);
+            auto same = [&](const Subscriber& s) { return s.to.sin_addr.s_addr == to.sin_addr.s_addr; };
+            auto kept = std::find_if(subscribers.begin(), subscribers.end(), same);
+            if (kept != subscribers.end()) {
+                next.push_back(std::move(*kept));
+                subscribers.erase(kept);
+            } else {
+                next.push_back({to, 0, TokenBucket(), {}, false});
+            }
+            next.back().rate = destination.rate;
+            next.back().limit.setRate(destination.rate, burst_ms);
+        }
+        for (const Subscriber& removed : subscribers) stats.dropped += removed.pending.size();
+        subscribers = std::move(next);
+        addr = subscribers.front().to;
     }
-};
 
-class NodeManager {
-private:
-    std::vector<uint16_t> node_ids;
-    std::map<uint16_t, std::pair<float, float>> positions;
-    std::vector<std::vector<float>> distances; // adjacency mat
-    std::random_device rd;
-    std::mt19937 gen;
-    std::uniform_real_distribution<float> pos_dist;
-    std::uniform_real_distribution<float> move_dist;
-    std::uniform_int_distribution<int> coin_toss;
-    
-public:
-    NodeManager() : gen(rd()), pos_dist(0.0f, 1000.0f), move_dist(-5.0f, 5.0f), coin_toss(0,9) {
-        for (int i = 1; i <= NUM_NODES; ++i) {
-            node_ids.push_back(i);
-            positions[i] = {pos_dist(gen), pos_dist(gen)};
-            union {
-                float f;
-                uint32_t i;
-            } u;
-            u.f = positions[i].first;
-            // std::cout << "Node " << i << ": x = " << u.f << " -> " << std::bitset<sizeof(float) * 8>(u.i) << ", y = " << positions[i].second << "\n";
-            std::vector<float> temp;
-            for (int j = 0; j < NUM_NODES; j++) {
-                temp.push_back(0);
+    // Byte rate cap of this stream (0 for none), what happens over a cap (high
+    // priority traffic is deferred, low priority dropped) and the depth of this
+    // stream's caps.
+    void setLimits(uint64_t bytes_per_s, bool high, int burst) {
+        burst_ms = burst;
+        stream_limit.setRate(bytes_per_s, burst_ms);
+        for (Subscriber& subscriber : subscribers) subscriber.limit.setRate(subscriber.rate, burst_ms);
+        high_priority = high;
+    }
+
+    // Requests a kernel send buffer of this many bytes (0 keeps the current one)
+    // and returns the size the kernel granted.
+    int setSendBuffer(int bytes) {
+        if (bytes > 0) setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (const char*)&bytes, sizeof(bytes));
+        int granted = 0;
+        socklen_t length = sizeof(granted);
+        getsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char*)&granted, &length);
+        return granted;
+    }
+
+    // Sends what the retry queues hold, oldest first per destination, until the
+    // kernel or the pacing pushes back again.
+    void drain() {
+        for (Subscriber& subscriber : subscribers) {
+            while (!subscriber.pending.empty()) {
+                Pending& message = subscriber.pending.front();
+                Attempt attempt = trySend(subscriber, message.data, message.size);
+                subscriber.capped = attempt == Attempt::Limited;
+                if (attempt == Attempt::Blocked) return;
+                if (attempt == Attempt::Limited) break;
+                subscriber.pending.pop_front();
             }
-            distances.push_back(temp);
         }
+    }
 
-        for (int i = 0; i < NUM_NODES; i++) {
-            uint16_t source_node = node_ids[i];
-            for (int j = i + 1; j < NUM_NODES; j++) {
-                uint16_t target_node = node_ids[j];
-                float dist = getDistance(source_node, target_node);
-                distances[i][j] = dist;
-                distances[j][i] = dist;
+    // The end of a tick: drains the retry queues and lets them hold as many
+    // datagrams as this tick sent, so a tick that meets pushback is queued whole.
+    void flush() override {
+        drain();
+        pending_limit = std::max(MAX_PENDING, tick_datagrams);
+        tick_datagrams = 0;
+    }
+
+    // Datagrams that are pushed back or deferred by a cap wait in their
+    // destination's retry queue, behind anything already there. Returns false
+    // when the call cost a datagram to a hard error or a low priority cap;
+    // retry queue overflow is counted on its own.
+    bool sendPacket(const void* data, size_t size) {
+        drain();
+        tick_datagrams++;
+        uint64_t lost = stats.dropped + stats.limit_dropped;
+        for (Subscriber& subscriber : subscribers) {
+            if (!subscriber.pending.empty()) {
+                enqueue(subscriber, data, size, subscriber.capped ? stats.limit_deferred : stats.deferred);
+                continue;
             }
+            Attempt attempt = trySend(subscriber, data, size);
+            subscriber.capped = attempt == Attempt::Limited;
+            if (attempt == Attempt::Blocked) enqueue(subscriber, data, size, stats.deferred);
+            if (attempt == Attempt::Limited) enqueue(subscriber, data, size, stats.limit_deferred);
         }
+        return stats.dropped + stats.limit_dropped == lost;
     }
-    
-    void updatePositions() {
-        for (auto& [id, pos] : positions) {
-            if (coin_toss(gen) % 2) {
-                pos.first += move_dist(gen);
-                pos.second += move_dist(gen);
-                
-                pos.first = std::max(0.0f, std::min(1000.0f, pos.first));
-                pos.second = std::max(0.0f, std::min(1000.0f, pos.second));
-            }   
-        }
+
+    size_t pendingCount() const {
+        size_t count = 0;
+        for (const Subscriber& subscriber : subscribers) count += subscriber.pending.size();
+        return count;
     }
-    
-    const std::vector<uint16_t>& getNodeIds() const { return node_ids; }
-    std::pair<float, float> getPosition(uint16_t id) const {
-        auto it = positions.find(id);
-        return it != positions.end() ? it->second : std::make_pair(0.0f, 0.0f);
+
+    SendStats sendStats() const {
+        SendStats current = stats;
+        current.backoffs = pacing.backoffs;
+        current.rate = pacing.current();
+        return current;
     }
 
-    float getDistance(uint16_t source_id, uint16_t target_id) {
-        float dx = positions[source_id].first - positions[target_id].first;
-        float dy = positions[source_id].second - positions[target_id].second;
-        return std::sqrtf(dx*dx + dy*dy);
-    } 
+    // Datagram by datagram through the caps and queues of sendPacket.
+    void sendBatch(const EndpointDatagram* batch, size_t count) override {
+        for (size_t i = 0; i < count; ++i) sendPacket(batch[i].data, batch[i].size);
+    }
+
+    int configure(const RuntimeConfig& config, uint64_t rate, bool high) override {
+        setDestinations(config.destinations);
+        setLimits(rate, high, config.rate_burst_ms);
+        return setSendBuffer(config.send_buffer);
+    }
+
+    bool spaced() const override { return true; }
+    std::string name() const override { return "port " + std::to_string(ntohs(addr.sin_port)); }
+    uint64_t droppedCount() const override { return stats.dropped + stats.limit_dropped; }
+    void report(const std::string& stream) const override { printSendStats(stream, sendStats()); }
 };
 
-class GraphGenerator {
+#ifdef __linux__
+// One non-blocking UDP socket per virtual node, bound either to its own loopback
+// address (127.1.x.y) or to its own port on 127.0.0.1, so receivers that key on
+// the source address see every node as a separate host. Datagrams that hit a
+// full socket buffer are queued on their endpoint and drained with sendmmsg once
+// epoll reports the socket writable again.
+class EndpointPool {
 private:
-    std::random_device rd;
-    std::mt19937 gen;
-    std::uniform_int_distribution<int> node_dist;
-    std::uniform_int_distribution<uint16_t> strength_dist;
-    std::uniform_int_distribution<int> edge_count_dist;
-    
-public:
-    GraphGenerator() : gen(rd()), node_dist(1, NUM_NODES), strength_dist(1, 1000), edge_count_dist(MIN_EDGES, MAX_EDGES) {}
-    
-    GraphPacket generateGraph(uint16_t sender_id) {
-        GraphPacket packet;
-        packet.sender_id = sender_id;
-        
-        int num_edges = edge_count_dist(gen);
-        packet.edge_count = num_edges;
-        
-        for (int i = 0; i < num_edges; ++i) {
-            packet.edges[i].source_id = node_dist(gen);
-            do {
-                packet.edges[i].target_id = node_dist(gen);
-            } while (packet.edges[i].target_id == packet.edges[i].source_id);
-            
-            packet.edges[i].strength = strength_dist(gen);
+    static constexpr size_t MAX_PENDING = 64; // per endpoint, oldest dropped first
+
+    struct Pending {
+        uint16_t port;
+        uint16_t size;
+        char data[MAX_DATAGRAM_SIZE];
+    };
+
+    struct Endpoint {
+        int sock = -1;
+        bool armed = false; // waiting for EPOLLOUT
+        std::deque<Pending> pending;
+    };
+
+    std::vector<Endpoint> endpoints; // indexed by node id
+    int epfd = -1;
+    std::mutex mutex;
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+
+    static void raiseFileLimit(rlim_t needed) {
+        rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return;
+        if (limit.rlim_cur >= needed) return;
+        limit.rlim_cur = std::min(needed, limit.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < needed) {
+            throw std::runtime_error("virtual endpoints need " + std::to_string(needed) +
+                                     " file descriptors, hard limit is " + std::to_string(limit.rlim_max));
         }
-        
-        return packet;
     }
-};
 
-void positionServer() {
-    try {
-        UDPServer server(12345);
-        NodeManager nodeManager;
-        
-        std::cout << "Position server started on port 12345\n";
-        
-        while (running) {
-            nodeManager.updatePositions();
-            
-            for (uint16_t node_id : nodeManager.getNodeIds()) {
-                PositionPacket packet;
-                packet.node_id = node_id;
-                auto pos = nodeManager.getPosition(node_id);
-                packet.x = pos.first;
-                packet.y = pos.second;
-
-                // std::cout << "Position Packet Size: " << sizeof(packet) << "\n";
-                union {
-                    float f;
-                    uint32_t i;
-                } u;
-
-                // std::cout << "\tid: " << packet.node_id << " -> " << std::bitset<8 * sizeof(uint16_t)>(packet.node_id) << "\n";
-                u.f = packet.x;
-                // std::cout << "\tx: " << packet.x << " -> " << std::bitset<8 * sizeof(float)>(u.i) << "\n";
-                u.f = packet.y;
-                // std::cout << "\ty: " << packet.y << " -> " << std::bitset<8 * sizeof(float)>(u.i) << "\n";
-                
-                uint16_t temp;
-                std::memcpy(&temp, &packet, sizeof(temp));
-                float tx, ty;
-                void* pack_ptr = (void *)(&packet);
+    void setArmed(uint16_t node_id, bool armed) {
+        Endpoint& endpoint = endpoints[node_id];
+        if (endpoint.armed == armed) return;
+        epoll_event ev{};
+        ev.events = armed ? (uint32_t)EPOLLOUT : 0u;
+        ev.data.u32 = node_id;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, endpoint.sock, &ev);
+        endpoint.armed = armed;
+    }
 
-                std::memcpy(&tx, (void*)((char*)pack_ptr + 4), sizeof(float));
-                std::memcpy(&ty, (void*)((char*)pack_ptr + 8), sizeof(float));
-                // std::cout << "id:" << temp << ", x = " << tx << ", y = " << ty << "\n";
+    void enqueue(uint16_t node_id, uint16_t port, const void* data, size_t size) {
+        Endpoint& endpoint = endpoints[node_id];
+        if (endpoint.pending.size() >= MAX_PENDING) {
+            endpoint.pending.pop_front();
+            dropped++;
+        }
+        endpoint.pending.emplace_back();
+        Pending& message = endpoint.pending.back();
+        message.port = port;
+        message.size = size;
+        std::memcpy(message.data, data, size);
+        setArmed(node_id, true);
+    }
 
-                std::memcpy((void*)((char*)pack_ptr + 2), &packet, sizeof(uint16_t));
-                server.sendPacket((void*)((char*)pack_ptr + 2), sizeof(packet) - sizeof(uint16_t));
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    // Sends as much of an endpoint's backlog as the socket takes, in one sendmmsg per 64 datagrams.
+    void drain(uint16_t node_id) {
+        Endpoint& endpoint = endpoints[node_id];
+        mmsghdr msgs[MAX_PENDING];
+        iovec iovs[MAX_PENDING];
+        sockaddr_in addrs[MAX_PENDING];
+        while (!endpoint.pending.empty()) {
+            unsigned count = std::min(endpoint.pending.size(), MAX_PENDING);
+            for (unsigned i = 0; i < count; ++i) {
+                Pending& message = endpoint.pending[i];
+                addrs[i] = destination(message.port);
+                iovs[i] = {message.data, message.size};
+                msgs[i] = {};
+                msgs[i].msg_hdr.msg_name = &addrs[i];
+                msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
             }
-            
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            int done = sendmmsg(endpoint.sock, msgs, count, 0);
+            if (done < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) return;
+                done = 1; // drop the datagram the kernel refuses outright
+                dropped++;
+            } else {
+                sent += done;
+            }
+            endpoint.pending.erase(endpoint.pending.begin(), endpoint.pending.begin() + done);
         }
+        setArmed(node_id, false);
+    }
 
-        std::cout << "Position server stopped.\n";
-    } catch (const std::exception& e) {
-        std::cerr << "Position server error: " << e.what() << std::endl;
+    static sockaddr_in destination(uint16_t port) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return addr;
     }
-}
 
-void graphServer() {
-    try {
-        UDPServer server(12346);
-        GraphGenerator graphGen;
-        
-        std::cout << "Graph server started on port 12346\n";
-        
-        while (running) {
-            for (uint16_t node_id = 1; node_id <= NUM_NODES; ++node_id) {
-                GraphPacket packet = graphGen.generateGraph(node_id);
-                server.sendPacket(&packet, sizeof(GraphPacket) - sizeof(GraphEdge) * (50 - packet.edge_count));
-                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+public:
+    EndpointPool(int num_nodes, EndpointMode mode, int base_port = ENDPOINT_BASE_PORT) : endpoints(num_nodes + 1) {
+        if (mode == EndpointMode::Port && base_port + num_nodes > 65535) {
+            throw std::runtime_error("too many nodes for one port per endpoint, use address mode");
+        }
+        raiseFileLimit(num_nodes + 64);
+
+        epfd = epoll_create1(0);
+        if (epfd < 0) throw std::runtime_error("Failed to create epoll instance");
+
+        for (int i = 1; i <= num_nodes; ++i) {
+            int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+            if (sock < 0) throw std::runtime_error("Failed to create endpoint socket for node " + std::to_string(i));
+            endpoints[i].sock = sock;
+
+            sockaddr_in local{};
+            local.sin_family = AF_INET;
+            if (mode == EndpointMode::Address) {
+                local.sin_addr.s_addr = htonl(0x7F010000u + i); // 127.1.0.0 + node id
+                local.sin_port = htons(base_port);
+            } else {
+                local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                local.sin_port = htons(base_port + i);
             }
-            
-            std::this_thread::sleep_for(std::chrono::seconds(2));
+            if (bind(sock, (sockaddr*)&local, sizeof(local)) < 0) {
+                throw std::runtime_error("Failed to bind endpoint for node " + std::to_string(i) + ": " + strerror(errno));
+            }
+
+            epoll_event ev{};
+            ev.events = 0;
+            ev.data.u32 = i;
+            if (epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev) < 0) throw std::runtime_error("Failed to register endpoint");
         }
+    }
 
-        std::cout << "Graph server stopped.\n";
-    } catch (const std::exception& e) {
-        std::cerr << "Graph server error: " << e.what() << std::endl;
+    ~EndpointPool() {
+        for (Endpoint& endpoint : endpoints) {
+            if (endpoint.sock >= 0) close(endpoint.sock);
+        }
+        if (epfd >= 0) close(epfd);
     }
-}
 
-int main() {
-    std::cout << "Starting UDP servers...\n";
-    
-    std::thread pos_thread(positionServer);
-    std::thread graph_thread(graphServer);
-    
-    std::cout << "Servers running. Press Enter to stop...\n";
-    std::cout << "Check of float: " << sizeof(float) << "bytes\n";
-    
-    std::cin.get();
+    // Drains backlogs of endpoints that became writable, waiting up to timeout_ms.
+    void flush(int timeout_ms = 0) {
+        std::lock_guard<std::mutex> guard(mutex);
+        epoll_event events[256];
+        int ready;
+        while ((ready = epoll_wait(epfd, events, 256, timeout_ms)) > 0) {
+            for (int i = 0; i < ready; ++i) drain(events[i].data.u32);
+            timeout_ms = 0;
+        }
+    }
 
-     running = false;
+    // Sends each datagram from its node's endpoint to the given loopback port.
+    void sendBatch(uint16_t port, const EndpointDatagram* batch, size_t count) {
+        flush();
+        std::lock_guard<std::mutex> guard(mutex);
+        sockaddr_in addr = destination(port);
+        for (size_t i = 0; i < count; ++i) {
+            const EndpointDatagram& datagram = batch[i];
+            if (datagram.node_id == 0 || datagram.node_id >= endpoints.size()) continue;
+            Endpoint& endpoint = endpoints[datagram.node_id];
+            if (!endpoint.pending.empty()) {
+                // keep per-endpoint ordering behind the backlog
+                enqueue(datagram.node_id, port, datagram.data, datagram.size);
+                continue;
+            }
+            if (sendto(endpoint.sock, datagram.data, datagram.size, 0, (sockaddr*)&addr, sizeof(addr)) >= 0) {
+                sent++;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                enqueue(datagram.node_id, port, datagram.data, datagram.size);
+            } else {
+                dropped++;
+            }
+        }
+    }
 
-    // Join threads
+    uint64_t sentCount() const { return sent; }
+    uint64_t droppedCount() const { return dropped; }
+};
+#else
+class EndpointPool {
+public:
+    EndpointPool(int, EndpointMode, int = ENDPOINT_BASE_PORT) { throw std::runtime_error("virtual endpoints need epoll (Linux only)"); }
+    void flush(int = 0) {}
+    void sendBatch(uint16_t, const EndpointDatagram*, size_t) {}
+    uint64_t sentCount() const { return 0; }
+    uint64_t droppedCount() const { return 0; }
+};
+#endif
+
+#ifdef __linux__
+// Same-host transport over AF_UNIX (--unix), in place of the UDP sockets: the
+// same datagrams without the IP and UDP layers.
+//   dgram      a receiver binds the stream's path, the announcer connects to it
+//   seqpacket  the announcer listens on the path and fans out to every
+//              receiver that connects
+// A tick's datagrams go out in one sendmmsg per receiver. Unlike UDP the kernel
+// pushes back when a receiver falls behind (a dgram receiver queues only
+// net.unix.max_dgram_qlen datagrams); the batch then waits for it up to
+// LOCAL_SEND_WAIT_MS and that receiver loses what is left, as it would have
+// over loopback UDP.
+class LocalSocketServer : public Transport {
+private:
+    LocalSocketType type;
+    std::string path;
+    int sock = -1; // dgram: the sending socket, seqpacket: the listener
+    bool connected = false; // dgram: to a receiver's bound path
+    std::vector<int> peers; // seqpacket connections
+    sockaddr_un addr{};
+    std::vector<mmsghdr> msgs;
+    std::vector<iovec> iovs;
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+
+    void acceptPeers() {
+        int peer;
+        while ((peer = accept4(sock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            int buffer = 4 << 20;
+            setsockopt(peer, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+            peers.push_back(peer);
+            std::cout << "Local " << path << ": receiver connected, " << peers.size() << " now\n";
+        }
+    }
+
+    // Sends msgs[0, count) on one socket. False once the receiver is gone.
+    bool sendAll(int to, unsigned count, std::chrono::steady_clock::time_point deadline) {
+        for (unsigned done = 0; done < count;) {
+            int n = sendmmsg(to, msgs.data() + done, count - done, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n > 0) {
+                sent += n;
+                done += n;
+                continue;
+            }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                pollfd writable{to, POLLOUT, 0};
+                if (left.count() > 0 && poll(&writable, 1, left.count()) > 0 && !(writable.revents & (POLLERR | POLLHUP))) continue;
+                dropped += count - done;
+                return true;
+            }
+            if (errno == EPIPE || errno == ECONNRESET || errno == ECONNREFUSED || errno == ENOTCONN) {
+                dropped += count - done;
+                return false;
+            }
+            dropped++; // the kernel refuses this one outright
+            done++;
+        }
+        return true;
+    }
+
+public:
+    LocalSocketServer(LocalSocketType socket_type, const std::string& socket_path) : type(socket_type), path(socket_path) {
+        if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("unix socket path too long: " + path);
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        if (type == LocalSocketType::Datagram) {
+            sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (sock < 0) throw std::runtime_error("Failed to create unix socket");
+            int buffer = 4 << 20;
+            setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+            return;
+        }
+        sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (sock < 0) throw std::runtime_error("Failed to create unix socket");
+        unlink(path.c_str());
+        if (bind(sock, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(sock, 16) < 0) {
+            close(sock);
+            throw std::runtime_error("Failed to listen on " + path + ": " + strerror(errno));
+        }
+    }
+
+    ~LocalSocketServer() {
+        for (int peer : peers) close(peer);
+        if (sock >= 0) close(sock);
+        if (type == LocalSocketType::SeqPacket) unlink(path.c_str());
+    }
+
+    LocalSocketServer(const LocalSocketServer&) = delete;
+    LocalSocketServer& operator=(const LocalSocketServer&) = delete;
+
+    void sendBatch(const EndpointDatagram* batch, size_t count) override {
+        msgs.resize(count);
+        iovs.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            iovs[i] = {(void*)batch[i].data, batch[i].size};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(LOCAL_SEND_WAIT_MS);
+        if (type == LocalSocketType::Datagram) {
+            // (re)connect per batch until a receiver has bound the path
+            if (!connected) connected = connect(sock, (sockaddr*)&addr, sizeof(addr)) == 0;
+            if (!connected) {
+                dropped += count;
+                return;
+            }
+            connected = sendAll(sock, count, deadline);
+            return;
+        }
+        acceptPeers();
+        for (size_t p = 0; p < peers.size();) {
+            if (sendAll(peers[p], count, deadline)) {
+                p++;
+                continue;
+            }
+            close(peers[p]);
+            peers.erase(peers.begin() + p);
+            std::cout << "Local " << path << ": receiver left, " << peers.size() << " now\n";
+        }
+    }
+
+    std::string name() const override { return path; }
+    uint64_t droppedCount() const override { return dropped; }
+    void report(const std::string& stream) const override {
+        std::cout << stream << " over unix sockets sent " << sent << " datagrams, dropped " << dropped << "\n";
+    }
+};
+#else
+class LocalSocketServer : public Transport {
+public:
+    LocalSocketServer(LocalSocketType, const std::string&) { throw std::runtime_error("unix socket transport is only built on Linux"); }
+    void sendBatch(const EndpointDatagram*, size_t) override {}
+    std::string name() const override { return ""; }
+    uint64_t droppedCount() const override { return 0; }
+};
+#endif
+
+// One stream's share of an EndpointPool, which both streams send through and
+// which reports for both at exit.
+class EndpointTransport : public Transport {
+private:
+    EndpointPool* pool;
+    uint16_t port;
+
+public:
+    EndpointTransport(EndpointPool* endpoints, uint16_t stream_port) : pool(endpoints), port(stream_port) {}
+
+    void sendBatch(const EndpointDatagram* batch, size_t count) override { pool->sendBatch(port, batch, count); }
+    void flush() override { pool->flush(); }
+    std::string name() const override { return "virtual endpoints to port " + std::to_string(port); }
+    uint64_t droppedCount() const override { return pool->droppedCount(); }
+};
+
+// Every datagram into the shared-memory ring (--shm), stamped once per batch.
+class ShmTransport : public Transport {
+private:
+    ShmRegion* region;
+    ShmStream stream;
+    std::string region_name;
+
+public:
+    ShmTransport(ShmRegion* shm, ShmStream shm_stream, const std::string& shm_name)
+        : region(shm), stream(shm_stream), region_name(shm_name) {}
+
+    void sendBatch(const EndpointDatagram* batch, size_t count) override {
+        int64_t now = announcerClockNs();
+        for (size_t i = 0; i < count; ++i) region->publish(stream, batch[i].data, batch[i].size, now);
+    }
+
+    std::string name() const override { return "shared memory " + region_name; }
+    uint64_t droppedCount() const override { return 0; }
+};
+
+// The stream's and the global byte rate caps in front of a backend that has no
+// queue of its own (--endpoints, --unix). Over a cap, high priority traffic waits
+// in a queue of its own for later batches and low priority traffic is dropped,
+// as UDPServer does; the per-destination caps are UDP's.
+class CappedTransport : public Transport {
+private:
+    static constexpr size_t MAX_PENDING = 1024; // least deferred datagrams held, oldest dropped first
+
+    std::unique_ptr<Transport> backend;
+    TokenBucket stream_limit;
+    bool high_priority = true;
+    std::vector<EndpointDatagram> pending; // deferred over a cap, oldest first
+    size_t pending_limit = MAX_PENDING;    // the last tick's datagrams, at least MAX_PENDING
+    size_t tick_datagrams = 0;             // handed to sendBatch since the last flush()
+    uint64_t limit_deferred = 0;
+    uint64_t limit_dropped = 0;
+    uint64_t overflowed = 0;
+
+    // How many datagrams from the front of the batch fit under both caps now; those are charged.
+    size_t admit(const EndpointDatagram* batch, size_t count) {
+        int64_t now = announcerClockNs();
+        size_t admitted = 0;
+        for (; admitted < count; ++admitted) {
+            size_t size = batch[admitted].size;
+            if (!stream_limit.fits(now, size) || !global_send_limit.take(now, size)) break;
+            stream_limit.charge(now, size);
+        }
+        return admitted;
+    }
+
+    void drain() {
+        size_t admitted = admit(pending.data(), pending.size());
+        if (!admitted) return;
+        backend->sendBatch(pending.data(), admitted);
+        pending.erase(pending.begin(), pending.begin() + admitted);
+    }
+
+public:
+    explicit CappedTransport(std::unique_ptr<Transport> capped) : backend(std::move(capped)) {}
+
+    // Deferred datagrams go first; while any are left the new ones queue behind them.
+    void sendBatch(const EndpointDatagram* batch, size_t count) override {
+        tick_datagrams += count;
+        drain();
+        size_t admitted = pending.empty() ? admit(batch, count) : 0;
+        if (admitted) backend->sendBatch(batch, admitted);
+        size_t left = count - admitted;
+        if (!left) return;
+        if (!high_priority) {
+            limit_dropped += left;
+            return;
+        }
+        limit_deferred += left;
+        pending.insert(pending.end(), batch + admitted, batch + count);
+        if (pending.size() > pending_limit) {
+            size_t excess = pending.size() - pending_limit;
+            pending.erase(pending.begin(), pending.begin() + excess);
+            overflowed += excess;
+        }
+    }
+
+    // The end of a tick, as UDPServer::flush: the queue may hold this tick's worth.
+    void flush() override {
+        drain();
+        pending_limit = std::max(MAX_PENDING, tick_datagrams);
+        tick_datagrams = 0;
+        backend->flush();
+    }
+
+    int configure(const RuntimeConfig& config, uint64_t rate, bool high) override {
+        stream_limit.setRate(rate, config.rate_burst_ms);
+        high_priority = high;
+        if (!high) {
+            // what waits now would never have been deferred; it counts as dropped
+            limit_dropped += pending.size();
+            pending.clear();
+        }
+        return backend->configure(config, rate, high);
+    }
+
+    bool spaced() const override { return backend->spaced(); }
+    std::string name() const override { return backend->name(); }
+    uint64_t droppedCount() const override { return backend->droppedCount() + limit_dropped; }
+
+    void report(const std::string& stream) const override {
+        backend->report(stream);
+        std::cout << stream << " over rate caps deferred " << limit_deferred << " and dropped " << limit_dropped
+                  << ", dropped from a full deferred queue " << overflowed << ", " << pending.size() << " still deferred\n";
+    }
+};
+
+// Sends nowhere: what the simulation costs without any output.
+class NullTransport : public Transport {
+public:
+    void sendBatch(const EndpointDatagram*, size_t) override {}
+    std::string name() const override { return "nowhere"; }
+    uint64_t droppedCount() const override { return 0; }
+};
+
+// Several backends as one. The first decides the spacing; the rest ride along.
+class TransportFanout : public Transport {
+private:
+    std::vector<std::unique_ptr<Transport>> backends;
+
+public:
+    void add(std::unique_ptr<Transport> backend) { backends.push_back(std::move(backend)); }
+
+    void sendBatch(const EndpointDatagram* batch, size_t count) override {
+        for (auto& backend : backends) backend->sendBatch(batch, count);
+    }
+
+    void flush() override {
+        for (auto& backend : backends) backend->flush();
+    }
+
+    int configure(const RuntimeConfig& config, uint64_t rate, bool high) override {
+        int granted = 0;
+        for (auto& backend : backends) granted = std::max(granted, backend->configure(config, rate, high));
+        return granted;
+    }
+
+    bool spaced() const override { return backends.front()->spaced(); }
+
+    std::string name() const override {
+        std::string names;
+        for (auto& backend : backends) names += (names.empty() ? "" : " and ") + backend->name();
+        return names;
+    }
+
+    uint64_t droppedCount() const override {
+        uint64_t dropped = 0;
+        for (auto& backend : backends) dropped += backend->droppedCount();
+        return dropped;
+    }
+
+    void report(const std::string& stream) const override {
+        for (auto& backend : backends) backend->report(stream);
+    }
+};
+
+// A stream's backends as the options pick them: UDP to the configured
+// destinations unless --endpoints or --unix takes its place, plus the
+// shared-memory ring with --shm.
+std::unique_ptr<Transport> openTransport(const Options& options, uint16_t port, const std::string& local_name, ShmStream stream,
+                                         EndpointPool* endpoints, ShmRegion* shm) {
+    std::unique_ptr<Transport> primary;
+    if (endpoints) {
+        primary.reset(new CappedTransport(std::unique_ptr<Transport>(new EndpointTransport(endpoints, port))));
+    } else if (options.local_socket != LocalSocketType::None) {
+        std::unique_ptr<Transport> local(new LocalSocketServer(options.local_socket, options.local_socket_dir + "/" + local_name));
+        primary.reset(new CappedTransport(std::move(local)));
+    } else {
+        primary.reset(new UDPServer(port));
+    }
+    if (!shm) return primary;
+    std::unique_ptr<TransportFanout> fanout(new TransportFanout());
+    fanout->add(std::move(primary));
+    fanout->add(std::unique_ptr<Transport>(new ShmTransport(shm, stream, options.shm_name)));
+    return fanout;
+}
+
+// Checkpoint file: a header page holding CheckpointHeader and the block table,
+// then every block starting on a CHECKPOINT_ALIGN boundary, so a restore can map
+// the file and use the arrays in place.
+constexpr uint64_t CHECKPOINT_MAGIC = 0x31305450434B414Eull; // "NAKCPT01"
+constexpr uint32_t CHECKPOINT_VERSION = 1;
+constexpr size_t CHECKPOINT_ALIGN = 4096;
+constexpr uint32_t MAX_CHECKPOINT_BLOCKS = 32;
+
+enum CheckpointBlockId : uint32_t {
+    BLOCK_NODE_STATE = 1,
+    BLOCK_NODE_XS,
+    BLOCK_NODE_YS,
+    BLOCK_NODE_POSITIONS,     // float mode, x, y pairs by node id
+    BLOCK_GRAPH_STATE,
+    BLOCK_GRAPH_SLOTS,
+    BLOCK_GRAPH_ALIVE,
+    BLOCK_GRAPH_EDGE_SETS,
+    BLOCK_GRAPH_WHEEL_OFFSETS, // WHEEL_SIZE + 1 event offsets
+    BLOCK_GRAPH_WHEEL_EVENTS,
+};
+
+struct CheckpointBlock {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct CheckpointHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t block_count;
+    uint64_t file_size;
+    CheckpointBlock blocks[MAX_CHECKPOINT_BLOCKS];
+};
+
+#ifndef _WIN32
+// Streams blocks to a file descriptor. It never allocates, so it can run in a
+// child forked from the multithreaded announcer.
+class CheckpointWriter {
+private:
+    int fd;
+    uint64_t offset = CHECKPOINT_ALIGN;
+    CheckpointHeader header = {};
+    bool ok = true;
+
+    void put(const void* data, size_t size) {
+        const char* p = (const char*)data;
+        while (ok && size) {
+            ssize_t done = write(fd, p, size);
+            if (done < 0 && errno == EINTR) continue;
+            if (done <= 0) ok = false;
+            else {
+                p += done;
+                size -= done;
+            }
+        }
+    }
+
+    void pad() {
+        static const char zeros[CHECKPOINT_ALIGN] = {};
+        size_t gap = (CHECKPOINT_ALIGN - offset % CHECKPOINT_ALIGN) % CHECKPOINT_ALIGN;
+        put(zeros, gap);
+        offset += gap;
+    }
+
+public:
+    explicit CheckpointWriter(int fd) : fd(fd) {
+        ok = lseek(fd, CHECKPOINT_ALIGN, SEEK_SET) == (off_t)CHECKPOINT_ALIGN;
+    }
+
+    void begin(uint32_t id) {
+        if (header.block_count == MAX_CHECKPOINT_BLOCKS) {
+            ok = false;
+            return;
+        }
+        pad();
+        header.blocks[header.block_count] = CheckpointBlock{id, 0, offset, 0};
+    }
+
+    void append(const void* data, size_t size) {
+        put(data, size);
+        offset += size;
+        header.blocks[header.block_count].size += size;
+    }
+
+    void end() { header.block_count++; }
+
+    void block(uint32_t id, const void* data, size_t size) {
+        begin(id);
+        append(data, size);
+        end();
+    }
+
+    bool finish() {
+        pad();
+        header.magic = CHECKPOINT_MAGIC;
+        header.version = CHECKPOINT_VERSION;
+        header.file_size = offset;
+        ok = ok && pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+        return ok;
+    }
+
+    uint64_t size() const { return offset; }
+};
+
+// A checkpoint mapped read-only. Blocks are read straight from the mapping.
+class CheckpointFile {
+private:
+    void* base = MAP_FAILED;
+    size_t length = 0;
+    const CheckpointHeader* header = nullptr;
+
+public:
+    explicit CheckpointFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Cannot open checkpoint " + path + ": " + strerror(errno));
+        struct stat st;
+        if (fstat(fd, &st) == 0) length = st.st_size;
+        if (length >= sizeof(CheckpointHeader)) base = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) throw std::runtime_error("Cannot map checkpoint " + path);
+        madvise(base, length, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+        header = (const CheckpointHeader*)base;
+        if (header->magic != CHECKPOINT_MAGIC || header->version != CHECKPOINT_VERSION) {
+            throw std::runtime_error("Not a checkpoint: " + path);
+        }
+        if (header->file_size != length || header->block_count > MAX_CHECKPOINT_BLOCKS) {
+            throw std::runtime_error("Truncated checkpoint: " + path);
+        }
+        for (uint32_t b = 0; b < header->block_count; ++b) {
+            const CheckpointBlock& block = header->blocks[b];
+            if (block.offset % CHECKPOINT_ALIGN || block.offset > length || block.size > length - block.offset) {
+                throw std::runtime_error("Corrupt checkpoint block table: " + path);
+            }
+        }
+    }
+
+    ~CheckpointFile() {
+        if (base != MAP_FAILED) munmap(base, length);
+    }
+
+    CheckpointFile(const CheckpointFile&) = delete;
+    CheckpointFile& operator=(const CheckpointFile&) = delete;
+
+    bool has(uint32_t id) const {
+        for (uint32_t b = 0; b < header->block_count; ++b) {
+            if (header->blocks[b].id == id) return true;
+        }
+        return false;
+    }
+
+    const char* block(uint32_t id, size_t& size) const {
+        for (uint32_t b = 0; b < header->block_count; ++b) {
+            if (header->blocks[b].id == id) {
+                size = header->blocks[b].size;
+                return (const char*)base + header->blocks[b].offset;
+            }
+        }
+        throw std::runtime_error("Checkpoint is missing block " + std::to_string(id));
+    }
+
+    template <typename T>
+    void read(uint32_t id, T& out) const {
+        size_t size;
+        const char* data = block(id, size);
+        if (size != sizeof(T)) throw std::runtime_error("Checkpoint block " + std::to_string(id) + " has the wrong size");
+        std::memcpy(&out, data, sizeof(T));
+    }
+
+    template <typename T>
+    void read(uint32_t id, std::vector<T>& out) const {
+        size_t size;
+        const char* data = block(id, size);
+        if (size % sizeof(T)) throw std::runtime_error("Checkpoint block " + std::to_string(id) + " has the wrong size");
+        out.resize(size / sizeof(T));
+        if (size) std::memcpy(out.data(), data, size);
+    }
+};
+#else
+class CheckpointWriter {
+public:
+    void begin(uint32_t) {}
+    void append(const void*, size_t) {}
+    void end() {}
+    void block(uint32_t, const void*, size_t) {}
+};
+
+class CheckpointFile {
+public:
+    explicit CheckpointFile(const std::string&) {
+        throw std::runtime_error("Checkpoints are only supported on POSIX systems");
+    }
+    bool has(uint32_t) const { return false; }
+    template <typename T> void read(uint32_t, T&) const {}
+};
+#endif
+
+// Counter-based random words: word `counter` of stream `key` is a pure function
+// of both, so blocks can be filled in any order, by SIMD lanes or by several
+// threads, and always come out the same.
+inline uint32_t randomWord(uint32_t key, uint32_t counter) {
+    uint32_t x = counter * 0x9E3779B9u ^ key;
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Hot loops get an AVX2 clone picked at load time where the toolchain supports it.
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+    #define SIMD_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+    #define SIMD_CLONES
+#endif
+
+constexpr int FIXED_SHIFT = 16; // fixed-point positions carry 16 fractional bits
+constexpr int32_t FIXED_ONE = 1 << FIXED_SHIFT;
+constexpr int32_t FIXED_WORLD = 1000 * FIXED_ONE;
+
+// Floor of the square root. The double estimate is corrected to the exact
+// integer result, so it does not depend on how the platform rounds.
+inline uint32_t isqrt64(uint64_t v) {
+    uint64_t r = (uint64_t)std::sqrt((double)v);
+    while (r * r > v) r--;
+    while ((r + 1) * (r + 1) <= v) r++;
+    return (uint32_t)r;
+}
+
+constexpr uint32_t MOVE_BLOCK = 64; // nodes per kernel call, fixed so the loop vectorizes
+
+// One fixed-point tick for the block of nodes starting at `first`: every move is
+// drawn from word 3i..3i+2 of the tick's stream and applied in integers, so
+// lanes and threads give bit-identical positions. Returns the block's share of
+// the position digest, counting only nodes below n. Moves span
+// [-(steps / 2), steps / 2] in fixed-point units, steps being odd.
+SIMD_CLONES
+uint64_t moveKernel(uint32_t key, uint32_t steps, uint32_t first, uint32_t n, int32_t* __restrict xs, int32_t* __restrict ys) {
+    uint64_t digest = 0;
+    int32_t reach = steps >> 1;
+    xs += first;
+    ys += first;
+    for (uint32_t j = 0; j < MOVE_BLOCK; ++j) {
+        uint32_t i = first + j;
+        uint32_t coin = randomWord(key, 3 * i) & 1;
+        int32_t dx = (int32_t)(((uint64_t)randomWord(key, 3 * i + 1) * steps) >> 32) - reach;
+        int32_t dy = (int32_t)(((uint64_t)randomWord(key, 3 * i + 2) * steps) >> 32) - reach;
+        int32_t x = xs[j] + (coin ? dx : 0);
+        int32_t y = ys[j] + (coin ? dy : 0);
+        xs[j] = x = std::max(0, std::min(FIXED_WORLD, x));
+        ys[j] = y = std::max(0, std::min(FIXED_WORLD, y));
+        digest += i < n ? randomWord((uint32_t)x ^ i * 0x85EBCA77u, (uint32_t)y) : 0;
+    }
+    return digest;
+}
+
+class NodeManager {
+private:
+    std::vector<uint16_t> node_ids;
+    std::map<uint16_t, std::pair<float, float>> positions;
+    std::random_device rd;
+    std::mt19937 gen;
+    std::uniform_real_distribution<float> pos_dist;
+    std::uniform_real_distribution<float> move_dist;
+    std::uniform_int_distribution<int> coin_toss;
+
+    // Fixed-point mode: positions are integers with FIXED_SHIFT fractional bits,
+    // kept as arrays indexed by node id - 1 (padded to whole blocks) and moved by
+    // moveKernel from a seeded counter stream, so a seed gives the same run on
+    // every compiler and platform.
+    bool fixed_point = false;
+    uint64_t seed = 0;
+    uint64_t tick = 0;
+    uint64_t position_digest = 0;
+    uint32_t move_steps = 2 * (uint32_t)(MOVE_DISTANCE * FIXED_ONE) + 1;
+    std::vector<int32_t> xs, ys;
+
+    static constexpr uint32_t PARALLEL_NODES = 1 << 14; // below this one thread is faster
+    unsigned max_threads = 0; // fan-out limit for moveFixed, 0 for one thread per core
+
+    uint64_t moveBlocks(uint32_t key, uint32_t first_block, uint32_t last_block) {
+        uint64_t digest = 0;
+        for (uint32_t b = first_block; b < last_block; ++b) {
+            digest += moveKernel(key, move_steps, b * MOVE_BLOCK, node_ids.size(), xs.data(), ys.data());
+        }
+        return digest;
+    }
+
+    void moveFixed(uint32_t key) {
+        uint32_t blocks = xs.size() / MOVE_BLOCK;
+        unsigned cores = max_threads ? max_threads : std::max(1u, std::thread::hardware_concurrency());
+        unsigned num_threads = node_ids.size() < PARALLEL_NODES ? 1 : std::min(blocks, cores);
+        if (num_threads <= 1) {
+            position_digest = moveBlocks(key, 0, blocks);
+            return;
+        }
+        // integer partial sums add up the same in any order
+        std::vector<uint64_t> partial(num_threads);
+        std::vector<std::thread> threads;
+        for (unsigned t = 1; t < num_threads; ++t) {
+            threads.emplace_back([&, t] { partial[t] = moveBlocks(key, blocks * t / num_threads, blocks * (t + 1) / num_threads); });
+        }
+        partial[0] = moveBlocks(key, 0, blocks / num_threads);
+        for (auto& thread : threads) thread.join();
+        position_digest = 0;
+        for (uint64_t part : partial) position_digest += part;
+    }
+    
+public:
+    NodeManager(int num_nodes = NUM_NODES) : gen(rd()), pos_dist(0.0f, 1000.0f), move_dist(-MOVE_DISTANCE, MOVE_DISTANCE), coin_toss(0,9) {
+        for (int i = 1; i <= num_nodes; ++i) {
+            node_ids.push_back(i);
+            positions[i] = {pos_dist(gen), pos_dist(gen)};
+            union {
+                float f;
+                uint32_t i;
+            } u;
+            u.f = positions[i].first;
+            // std::cout << "Node " << i << ": x = " << u.f << " -> " << std::bitset<sizeof(float) * 8>(u.i) << ", y = " << positions[i].second << "\n";
+        }
+    }
+    
+    // Largest step per axis per tick, in world units, for both position modes.
+    void setMoveDistance(float distance) {
+        move_dist = std::uniform_real_distribution<float>(-distance, distance);
+        move_steps = 2 * (uint32_t)std::lround(distance * FIXED_ONE) + 1;
+    }
+
+    // Caps the threads a position update fans out to (0 for one per core).
+    // Hosts that schedule their own worker threads keep a tick on its worker with 1.
+    void setMaxThreads(unsigned threads) { max_threads = threads; }
+
+    // Switches to fixed-point mode with fresh positions drawn from the seed.
+    void useFixedPoint(uint64_t fixed_seed) {
+        fixed_point = true;
+        seed = fixed_seed;
+        tick = 0;
+        uint32_t key = splitmix64(seed);
+        size_t padded = (node_ids.size() + MOVE_BLOCK - 1) / MOVE_BLOCK * MOVE_BLOCK;
+        xs.assign(padded, 0);
+        ys.assign(padded, 0);
+        for (uint32_t i = 0; i < node_ids.size(); ++i) {
+            xs[i] = ((uint64_t)randomWord(key, 2 * i) * (FIXED_WORLD + 1)) >> 32;
+            ys[i] = ((uint64_t)randomWord(key, 2 * i + 1) * (FIXED_WORLD + 1)) >> 32;
+        }
+    }
+
+    struct CheckpointState {
+        uint32_t num_nodes;
+        uint32_t fixed_point;
+        uint64_t seed;
+        uint64_t tick;
+        uint64_t digest;
+    };
+
+    void checkpoint(CheckpointWriter& out) const {
+        CheckpointState state{(uint32_t)node_ids.size(), fixed_point, seed, tick, position_digest};
+        out.block(BLOCK_NODE_STATE, &state, sizeof(state));
+        if (fixed_point) {
+            out.block(BLOCK_NODE_XS, xs.data(), xs.size() * sizeof(int32_t));
+            out.block(BLOCK_NODE_YS, ys.data(), ys.size() * sizeof(int32_t));
+            return;
+        }
+        // float mode keeps positions in a map; stream them out in id order
+        out.begin(BLOCK_NODE_POSITIONS);
+        float chunk[512];
+        size_t n = 0;
+        for (const auto& [id, pos] : positions) {
+            chunk[n++] = pos.first;
+            chunk[n++] = pos.second;
+            if (n == 512) {
+                out.append(chunk, sizeof(chunk));
+                n = 0;
+            }
+        }
+        out.append(chunk, n * sizeof(float));
+        out.end();
+    }
+
+    // Takes over positions and the fixed-point stream position. The float mode's
+    // mt19937 is not saved; it carries on from a fresh seed.
+    void restore(const CheckpointFile& in) {
+        CheckpointState state;
+        in.read(BLOCK_NODE_STATE, state);
+        if (state.num_nodes != node_ids.size()) throw std::runtime_error("Checkpoint is for a different node count");
+        fixed_point = state.fixed_point;
+        seed = state.seed;
+        tick = state.tick;
+        position_digest = state.digest;
+        if (fixed_point) {
+            in.read(BLOCK_NODE_XS, xs);
+            in.read(BLOCK_NODE_YS, ys);
+            if (xs.size() != ys.size() || xs.size() < node_ids.size() || xs.size() % MOVE_BLOCK) {
+                throw std::runtime_error("Checkpoint position arrays do not match the node count");
+            }
+            return;
+        }
+        std::vector<float> saved;
+        in.read(BLOCK_NODE_POSITIONS, saved);
+        if (saved.size() != 2 * node_ids.size()) throw std::runtime_error("Checkpoint positions do not match the node count");
+        for (size_t i = 0; i < node_ids.size(); ++i) positions[node_ids[i]] = {saved[2 * i], saved[2 * i + 1]};
+    }
+
+    bool fixedPoint() const { return fixed_point; }
+    uint64_t ticks() const { return tick; }
+    // Wrapping sum of a hash of every position after the last fixed-point tick.
+    uint64_t digest() const { return position_digest; }
+
+    void updatePositions() {
+        if (fixed_point) {
+            moveFixed(splitmix64(seed ^ splitmix64(++tick)));
+            return;
+        }
+        for (auto& [id, pos] : positions) {
+            if (coin_toss(gen) % 2) {
+                pos.first += move_dist(gen);
+                pos.second += move_dist(gen);
+                
+                pos.first = std::max(0.0f, std::min(1000.0f, pos.first));
+                pos.second = std::max(0.0f, std::min(1000.0f, pos.second));
+            }   
+        }
+    }
+    
+    const std::vector<uint16_t>& getNodeIds() const { return node_ids; }
+    std::pair<float, float> getPosition(uint16_t id) const {
+        if (fixed_point) {
+            if (id < 1 || id > node_ids.size()) return {0.0f, 0.0f};
+            return {(float)xs[id - 1] / FIXED_ONE, (float)ys[id - 1] / FIXED_ONE};
+        }
+        auto it = positions.find(id);
+        return it != positions.end() ? it->second : std::make_pair(0.0f, 0.0f);
+    }
+
+    float getDistance(uint16_t source_id, uint16_t target_id) {
+        if (fixed_point) {
+            int64_t dx = xs[source_id - 1] - xs[target_id - 1];
+            int64_t dy = ys[source_id - 1] - ys[target_id - 1];
+            // squared distance in 2 * FIXED_SHIFT fractional bits, root back in FIXED_SHIFT
+            return (float)isqrt64(dx*dx + dy*dy) / FIXED_ONE;
+        }
+        float dx = positions[source_id].first - positions[target_id].first;
+        float dy = positions[source_id].second - positions[target_id].second;
+        return std::sqrt(dx*dx + dy*dy);
+    } 
+};
+
+// Lemire's multiply-shift reduction of a random word into [0, size). Products
+// whose low half falls under `threshold` would be biased and must be redrawn.
+struct LemireRange {
+    uint32_t size;
+    uint32_t threshold;
+
+    explicit LemireRange(uint32_t n = 1) : size(n), threshold((0u - n) % n) {}
+
+    // Exact draw, redrawing from the same stream until the product is unbiased.
+    uint32_t draw(uint32_t key, uint32_t& counter) const {
+        uint64_t m;
+        do {
+            m = (uint64_t)randomWord(key, counter++) * size;
+        } while ((uint32_t)m < threshold);
+        return m >> 32;
+    }
+};
+
+constexpr uint32_t EDGE_BLOCK = 64; // edges per kernel call, fixed so the loop vectorizes
+constexpr uint32_t PAIR_FILTER_BITS = 10; // slots of the per-packet repeated pair filter, as a power of two
+
+// Product of a random word and a factor below 2^16, high word returned and low
+// word in `low`. Built from two 16 x 16 bit products so it stays in 32-bit
+// lanes, which AVX2 multiplies eight at a time; exact, as node ids are 16 bit.
+inline uint32_t mulWide(uint32_t word, uint32_t factor, uint32_t& low) {
+    uint32_t lo = (word & 0xFFFF) * factor;
+    uint32_t mid = (word >> 16) * factor + (lo >> 16);
+    low = mid << 16 | (lo & 0xFFFF);
+    return mid >> 16;
+}
+
+// Slot of a (source << 16 | target) pair in the per-packet repeated pair filter.
+inline uint16_t pairFilterSlot(uint32_t pair) { return (pair * 0x9E3779B1u) >> (32 - PAIR_FILTER_BITS); }
+
+// Draws edge `index` of a call over n nodes from two random words: the first is
+// reduced twice (batched Lemire) into the source and an offset to a different
+// target, the second into the strength. A biased draw is flagged rather than
+// retried so loops over it stay branch-free. The pair's filter slot comes along,
+// so the packing pass only looks it up.
+inline uint8_t drawEdge(uint32_t key, uint32_t index, uint32_t n, uint32_t pair_threshold, uint32_t strength_threshold,
+                        GraphEdge& edge, uint16_t& filter_slot) {
+    uint32_t ms, mt, mw;
+    uint32_t s = mulWide(randomWord(key, 2 * index), n, ms);
+    uint32_t t = s + 1 + mulWide(ms, n - 1, mt); // skip over the source instead of retrying
+    uint32_t strength = mulWide(randomWord(key, 2 * index + 1), 1000, mw);
+    t -= t >= n ? n : 0;
+    edge.source_id = s + 1;
+    edge.target_id = t + 1;
+    edge.strength = strength + 1;
+    filter_slot = pairFilterSlot((s + 1) << 16 | (t + 1));
+    return (mt < pair_threshold) | (mw < strength_threshold);
+}
+
+SIMD_CLONES
+void edgeKernel(uint32_t key, uint32_t first, uint32_t n, uint32_t pair_threshold, uint32_t strength_threshold,
+                GraphEdge* __restrict edges, uint16_t* __restrict filter_slots, uint8_t* __restrict biased) {
+    for (uint32_t i = 0; i < EDGE_BLOCK; ++i) {
+        biased[i] = drawEdge(key, first + i, n, pair_threshold, strength_threshold, edges[i], filter_slots[i]);
+    }
+}
+
+// Duplicate-free (source, target) pairs of one sender: 128 four-byte slots with
+// linear probing and backward-shift deletion, so membership stays O(1) at the
+// 50-edge packet limit and no tombstones build up.
+class EdgeSet {
+private:
+    static constexpr uint32_t SIZE = 128;
+    uint32_t keys[SIZE] = {}; // source << 16 | target, 0 = empty (ids start at 1)
+
+    static uint32_t home(uint32_t key) { return (key * 0x9E3779B1u) >> 25; }
+
+public:
+    static uint32_t key(uint16_t source, uint16_t target) { return (uint32_t)source << 16 | target; }
+
+    // Steps (source, target) to the next distinct pair over n nodes, cycling through all n * (n - 1).
+    static void nextPair(uint16_t& source, uint16_t& target, uint32_t n) {
+        do {
+            if (++target > n) {
+                target = 1;
+                source = source % n + 1;
+            }
+        } while (target == source);
+    }
+
+    bool contains(uint32_t key) const {
+        for (uint32_t i = home(key);; i = (i + 1) & (SIZE - 1)) {
+            if (keys[i] == key) return true;
+            if (keys[i] == 0) return false;
+        }
+    }
+
+    // Returns false if the pair was already present.
+    bool insert(uint32_t key) {
+        uint32_t i = home(key);
+        for (; keys[i] != 0; i = (i + 1) & (SIZE - 1)) {
+            if (keys[i] == key) return false;
+        }
+        keys[i] = key;
+        return true;
+    }
+
+    void erase(uint32_t key) {
+        uint32_t i = home(key);
+        for (; keys[i] != key; i = (i + 1) & (SIZE - 1)) {
+            if (keys[i] == 0) return;
+        }
+        // pull later entries of the probe run back over the hole
+        for (uint32_t j = (i + 1) & (SIZE - 1); keys[j] != 0; j = (j + 1) & (SIZE - 1)) {
+            uint32_t h = home(keys[j]);
+            if (((j - h) & (SIZE - 1)) >= ((j - i) & (SIZE - 1))) {
+                keys[i] = keys[j];
+                i = j;
+            }
+        }
+        keys[i] = 0;
+    }
+
+    void clear() { std::memset(keys, 0, sizeof(keys)); }
+};
+
+// One edge birth, death or strength change of the evolving graph model.
+struct EdgeChange {
+    enum Kind : uint8_t { Born, Died, Drifted };
+    Kind kind;
+    uint16_t sender_id;
+    GraphEdge edge;        // state after the change, or the last state for Died
+    uint16_t old_strength; // before a drift
+};
+
+class GraphGenerator {
+private:
+    static constexpr uint32_t PARALLEL_EDGES = 1 << 16; // below this one thread is faster
+    unsigned max_threads = 0;                           // fan-out limit for generateGraphs, 0 for one per core
+    static constexpr uint32_t SLOTS = 50;               // edges a sender can hold, one packet's worth
+    static constexpr uint32_t WHEEL_SIZE = 256;         // ticks covered by the event wheel
+
+    // Evolving model: every sender owns SLOTS edge slots. Deaths and drifts are
+    // scheduled on a timing wheel, so a tick only visits the edges that change.
+    struct EdgeSlot {
+        GraphEdge edge;
+        uint32_t generation; // bumped on death, invalidates pending events of the old edge
+    };
+
+    struct EdgeEvent {
+        uint32_t tick;
+        uint16_t sender_id;
+        uint8_t slot;
+        uint8_t kind; // EdgeChange::Died or EdgeChange::Drifted
+        uint32_t generation;
+    };
+
+    std::random_device rd;
+    uint64_t seed;
+    uint64_t calls = 0; // stream position, one fresh key per call
+    int num_nodes;
+    LemireRange node_range, other_range, strength_range, count_range;
+    uint32_t pair_threshold; // for the batched source/target draw over n * (n - 1)
+    int min_edges;
+    std::vector<uint32_t> offsets; // staging, reused across calls
+    std::vector<GraphEdge> edges;
+    std::vector<uint16_t> filter_slots; // pairFilterSlot of every staged edge
+    // Repeated pair filter: a slot holds the number of the packet that last used
+    // it, so a new packet starts with an empty filter without clearing it.
+    uint16_t pair_filter[1 << PAIR_FILTER_BITS] = {};
+    uint16_t filter_packet = 0;
+
+    GraphModel model;
+    uint32_t tick = 0;
+    uint32_t model_key;
+    uint32_t model_counter = 0;
+    std::vector<EdgeSlot> slots;   // SLOTS per sender, indexed by sender id
+    std::vector<uint64_t> alive;   // occupied slot bits per sender
+    std::vector<EdgeSet> edge_sets; // live pairs per sender
+    std::vector<std::vector<EdgeEvent>> wheel;
+    std::vector<EdgeEvent> due;
+    std::vector<EdgeChange> changes;
+
+    float uniform() { return (randomWord(model_key, model_counter++) >> 8) * (1.0f / 16777216.0f); }
+
+    // Ticks until the next event of a process with the given mean interval (at least 1).
+    uint32_t geometric(float mean) {
+        float u = 1.0f - uniform();
+        return 1 + (uint32_t)std::min(1e6f, std::floor(std::log(u) / std::log(1.0f - 1.0f / mean)));
+    }
+
+    uint32_t poisson(float mean) {
+        if (mean > 30) {
+            float u1 = 1.0f - uniform(), u2 = uniform();
+            float normal = std::sqrt(-2.0f * std::log(u1)) * std::cos(6.2831853f * u2);
+            return (uint32_t)std::max(0.0f, std::round(mean + std::sqrt(mean) * normal));
+        }
+        float limit = std::exp(-mean), product = uniform();
+        uint32_t count = 0;
+        while (product > limit) {
+            product *= uniform();
+            count++;
+        }
+        return count;
+    }
+
+    void schedule(uint16_t sender_id, uint8_t slot, uint8_t kind, uint32_t delay) {
+        EdgeEvent event{tick + delay, sender_id, slot, kind, slots[sender_id * SLOTS + slot].generation};
+        wheel[event.tick % WHEEL_SIZE].push_back(event);
+    }
+
+    void birth(uint16_t sender_id) {
+        uint64_t free_slots = ~alive[sender_id] & ((1ull << SLOTS) - 1);
+        if (!free_slots) return;
+        uint8_t slot = __builtin_ctzll(free_slots);
+        EdgeSlot& edge_slot = slots[sender_id * SLOTS + slot];
+
+        uint32_t s = node_range.draw(model_key, model_counter);
+        uint32_t t = s + 1 + other_range.draw(model_key, model_counter);
+        t -= t >= node_range.size ? node_range.size : 0;
+        uint16_t source = s + 1, target = t + 1;
+        if ((uint32_t)__builtin_popcountll(alive[sender_id]) >= node_range.size * (node_range.size - 1)) return;
+        while (!edge_sets[sender_id].insert(EdgeSet::key(source, target))) {
+            EdgeSet::nextPair(source, target, node_range.size);
+        }
+        edge_slot.edge = {source, target, (uint16_t)(strength_range.draw(model_key, model_counter) + 1)};
+        alive[sender_id] |= 1ull << slot;
+
+        schedule(sender_id, slot, EdgeChange::Died, geometric(EDGE_LIFETIME_TICKS));
+        schedule(sender_id, slot, EdgeChange::Drifted, geometric(EDGE_DRIFT_TICKS));
+        changes.push_back({EdgeChange::Born, sender_id, edge_slot.edge, 0});
+    }
+
+    void apply(const EdgeEvent& event) {
+        EdgeSlot& edge_slot = slots[event.sender_id * SLOTS + event.slot];
+        if (edge_slot.generation != event.generation) return; // edge died since
+        if (event.kind == EdgeChange::Died) {
+            alive[event.sender_id] &= ~(1ull << event.slot);
+            edge_sets[event.sender_id].erase(EdgeSet::key(edge_slot.edge.source_id, edge_slot.edge.target_id));
+            edge_slot.generation++;
+            changes.push_back({EdgeChange::Died, event.sender_id, edge_slot.edge, 0});
+        } else {
+            uint16_t old_strength = edge_slot.edge.strength;
+            int step = (int)(uniform() * (2 * EDGE_DRIFT_STEP + 1)) - EDGE_DRIFT_STEP;
+            edge_slot.edge.strength = std::max(1, std::min(1000, old_strength + step));
+            schedule(event.sender_id, event.slot, EdgeChange::Drifted, geometric(EDGE_DRIFT_TICKS));
+            changes.push_back({EdgeChange::Drifted, event.sender_id, edge_slot.edge, old_strength});
+        }
+    }
+
+    // Fills edge blocks [first_block, last_block) of a call with the vector
+    // kernel, then redraws the rare biased edges exactly from a per-edge side stream.
+    void fillEdges(uint32_t key, uint32_t first_block, uint32_t last_block) {
+        uint8_t biased[EDGE_BLOCK];
+        for (uint32_t block = first_block; block < last_block; ++block) {
+            uint32_t first = block * EDGE_BLOCK;
+            edgeKernel(key, first, node_range.size, pair_threshold, strength_range.threshold, &edges[first],
+                       &filter_slots[first], biased);
+
+            for (uint32_t i = 0; i < EDGE_BLOCK; ++i) {
+                if (!biased[i]) continue;
+                uint32_t counter = 0;
+                uint32_t fix_key = key ^ splitmix64(first + i);
+                uint32_t s = node_range.draw(fix_key, counter);
+                uint32_t t = s + 1 + other_range.draw(fix_key, counter);
+                t -= t >= node_range.size ? node_range.size : 0;
+                edges[first + i].source_id = s + 1;
+                edges[first + i].target_id = t + 1;
+                edges[first + i].strength = strength_range.draw(fix_key, counter) + 1;
+                filter_slots[first + i] = pairFilterSlot(EdgeSet::key(s + 1, t + 1));
+            }
+        }
+    }
+
+    void copyEdgeSet(uint16_t sender_id, GraphPacket& packet) const {
+        packet.sender_id = sender_id;
+        packet.edge_count = 0;
+        const EdgeSlot* sender_slots = &slots[sender_id * SLOTS];
+        for (uint64_t bits = alive[sender_id]; bits; bits &= bits - 1) {
+            packet.edges[packet.edge_count++] = sender_slots[__builtin_ctzll(bits)].edge;
+        }
+    }
+
+    // Moves edges[i] off any pair already used by edges[0..i), returning the filter slot of the result.
+    uint32_t dedupe(GraphEdge* edges, uint32_t i) const {
+        for (;;) {
+            uint32_t key = EdgeSet::key(edges[i].source_id, edges[i].target_id);
+            bool repeated = false;
+            for (uint32_t j = 0; j < i && !repeated; ++j) {
+                repeated = EdgeSet::key(edges[j].source_id, edges[j].target_id) == key;
+            }
+            if (!repeated) return pairFilterSlot(key);
+            EdgeSet::nextPair(edges[i].source_id, edges[i].target_id, node_range.size);
+        }
+    }
+
+public:
+    GraphGenerator(int num_nodes = NUM_NODES, int min_edges = MIN_EDGES, int max_edges = MAX_EDGES)
+        : seed(((uint64_t)rd() << 32) | rd()), num_nodes(num_nodes), node_range(num_nodes), other_range(num_nodes - 1),
+          strength_range(1000), count_range(std::min(max_edges, 50) - min_edges + 1),
+          pair_threshold((0u - (uint32_t)num_nodes * (num_nodes - 1)) % ((uint32_t)num_nodes * (num_nodes - 1))),
+          min_edges(min_edges), model(GraphModel::Random), model_key(splitmix64(seed ^ 0x5851F42D4C957F2Dull)) {}
+
+    GraphGenerator(int num_nodes, int min_edges, int max_edges, GraphModel graph_model)
+        : GraphGenerator(num_nodes, min_edges, max_edges) {
+        model = graph_model;
+        if (model != GraphModel::Evolving) return;
+
+        slots.assign((num_nodes + 1) * SLOTS, EdgeSlot{});
+        alive.assign(num_nodes + 1, 0);
+        edge_sets.assign(num_nodes + 1, EdgeSet{});
+        wheel.resize(WHEEL_SIZE);
+        // start every sender with a packet's worth of edges; lifetimes are memoryless
+        for (int sender_id = 1; sender_id <= num_nodes; ++sender_id) {
+            uint32_t count = min_edges + count_range.draw(model_key, model_counter);
+            for (uint32_t i = 0; i < count; ++i) birth(sender_id);
+        }
+        changes.clear();
+    }
+
+    // Caps the threads generateGraphs fans out to, as NodeManager::setMaxThreads.
+    void setMaxThreads(unsigned threads) { max_threads = threads; }
+
+    // New edge count range for later packets. Evolving edge sets are not cut
+    // back; birth rates follow the new mean and the sets drift towards it.
+    void setEdgeRange(int new_min_edges, int new_max_edges) {
+        min_edges = new_min_edges;
+        count_range = LemireRange(std::min(new_max_edges, 50) - new_min_edges + 1);
+    }
+
+    struct CheckpointState {
+        uint64_t seed;
+        uint64_t calls;
+        uint32_t num_nodes;
+        uint32_t min_edges;
+        uint32_t count_range;
+        uint32_t model;
+        uint32_t tick;
+        uint32_t model_key;
+        uint32_t model_counter;
+        uint32_t reserved;
+    };
+
+    void checkpoint(CheckpointWriter& out) const {
+        CheckpointState state{seed, calls, (uint32_t)num_nodes, (uint32_t)min_edges, count_range.size,
+                              (uint32_t)model, tick, model_key, model_counter, 0};
+        out.block(BLOCK_GRAPH_STATE, &state, sizeof(state));
+        if (model != GraphModel::Evolving) return;
+        out.block(BLOCK_GRAPH_SLOTS, slots.data(), slots.size() * sizeof(EdgeSlot));
+        out.block(BLOCK_GRAPH_ALIVE, alive.data(), alive.size() * sizeof(uint64_t));
+        out.block(BLOCK_GRAPH_EDGE_SETS, edge_sets.data(), edge_sets.size() * sizeof(EdgeSet));
+        // the wheel goes out flattened: bucket offsets, then every bucket's events
+        uint32_t wheel_offsets[WHEEL_SIZE + 1];
+        wheel_offsets[0] = 0;
+        for (uint32_t b = 0; b < WHEEL_SIZE; ++b) wheel_offsets[b + 1] = wheel_offsets[b] + wheel[b].size();
+        out.block(BLOCK_GRAPH_WHEEL_OFFSETS, wheel_offsets, sizeof(wheel_offsets));
+        out.begin(BLOCK_GRAPH_WHEEL_EVENTS);
+        for (const auto& bucket : wheel) out.append(bucket.data(), bucket.size() * sizeof(EdgeEvent));
+        out.end();
+    }
+
+    void restore(const CheckpointFile& in) {
+        CheckpointState state;
+        in.read(BLOCK_GRAPH_STATE, state);
+        if (state.num_nodes != (uint32_t)num_nodes || state.model != (uint32_t)model) {
+            throw std::runtime_error("Checkpoint graph settings differ from this run");
+        }
+        if (state.count_range == 0 || state.min_edges + state.count_range > 51) {
+            throw std::runtime_error("Checkpoint edge range is invalid");
+        }
+        // the edge range is runtime config; continue with the checkpointed one
+        min_edges = state.min_edges;
+        count_range = LemireRange(state.count_range);
+        seed = state.seed;
+        calls = state.calls;
+        tick = state.tick;
+        model_key = state.model_key;
+        model_counter = state.model_counter;
+        if (model != GraphModel::Evolving) return;
+
+        in.read(BLOCK_GRAPH_SLOTS, slots);
+        in.read(BLOCK_GRAPH_ALIVE, alive);
+        in.read(BLOCK_GRAPH_EDGE_SETS, edge_sets);
+        std::vector<uint32_t> wheel_offsets;
+        std::vector<EdgeEvent> events;
+        in.read(BLOCK_GRAPH_WHEEL_OFFSETS, wheel_offsets);
+        in.read(BLOCK_GRAPH_WHEEL_EVENTS, events);
+        if (slots.size() != (num_nodes + 1) * SLOTS || alive.size() != (size_t)num_nodes + 1 ||
+            edge_sets.size() != (size_t)num_nodes + 1 || wheel_offsets.size() != WHEEL_SIZE + 1 ||
+            wheel_offsets[WHEEL_SIZE] != events.size()) {
+            throw std::runtime_error("Checkpoint graph arrays do not match the node count");
+        }
+        for (uint32_t b = 0; b < WHEEL_SIZE; ++b) {
+            if (wheel_offsets[b] > wheel_offsets[b + 1]) throw std::runtime_error("Corrupt checkpoint event wheel");
+            wheel[b].assign(events.begin() + wheel_offsets[b], events.begin() + wheel_offsets[b + 1]);
+        }
+    }
+
+    // Advances the evolving model by one tick (a graph round): new edges appear as
+    // a Poisson process balancing the mean lifetime, and only edges with a death
+    // or drift due this tick are visited. Returns what changed.
+    const std::vector<EdgeChange>& advance() {
+        changes.clear();
+        if (model != GraphModel::Evolving) return changes;
+        tick++;
+
+        float mean_edges = min_edges + (count_range.size - 1) / 2.0f;
+        uint32_t births = poisson(num_nodes * mean_edges / EDGE_LIFETIME_TICKS);
+        for (uint32_t i = 0; i < births; ++i) birth(node_range.draw(model_key, model_counter) + 1);
+
+        due.clear();
+        due.swap(wheel[tick % WHEEL_SIZE]);
+        for (const EdgeEvent& event : due) {
+            if (event.tick > tick) {
+                wheel[tick % WHEEL_SIZE].push_back(event); // due in a later lap of the wheel
+            } else {
+                apply(event);
+            }
+        }
+        return changes;
+    }
+
+    const std::vector<EdgeChange>& lastChanges() const { return changes; }
+
+    // Generates graphs for senders first_sender .. first_sender + count - 1 (wrapping
+    // after num_nodes) with one pass over all of their edges.
+    void generateGraphs(uint16_t first_sender, int count, GraphPacket* out) {
+        if (model == GraphModel::Evolving) {
+            for (int p = 0; p < count; ++p) copyEdgeSet((first_sender - 1 + p) % num_nodes + 1, out[p]);
+            return;
+        }
+
+        uint32_t key = splitmix64(seed + calls++);
+        uint32_t count_key = key ^ 0xC2B2AE35u;
+
+        offsets.assign(count + 1, 0);
+        for (int p = 0; p < count; ++p) {
+            uint32_t counter = p;
+            uint64_t m = (uint64_t)randomWord(count_key, counter) * count_range.size;
+            if ((uint32_t)m < count_range.threshold) {
+                counter = 0;
+                m = (uint64_t)count_range.draw(count_key ^ splitmix64(p), counter) << 32;
+            }
+            uint32_t possible = node_range.size * (node_range.size - 1);
+            offsets[p + 1] = offsets[p] + std::min(possible, min_edges + (uint32_t)(m >> 32));
+        }
+
+        // the last block is drawn in full and its spare edges ignored
+        uint32_t total = offsets[count];
+        uint32_t blocks = (total + EDGE_BLOCK - 1) / EDGE_BLOCK;
+        edges.resize(blocks * EDGE_BLOCK);
+        filter_slots.resize(blocks * EDGE_BLOCK);
+
+        unsigned cores = max_threads ? max_threads : std::max(1u, std::thread::hardware_concurrency());
+        unsigned num_threads = total < PARALLEL_EDGES ? 1 : std::min(blocks, cores);
+        if (num_threads <= 1) {
+            fillEdges(key, 0, blocks);
+        } else {
+            std::vector<std::thread> threads;
+            for (unsigned t = 1; t < num_threads; ++t) {
+                threads.emplace_back(&GraphGenerator::fillEdges, this, key, blocks * t / num_threads, blocks * (t + 1) / num_threads);
+            }
+            fillEdges(key, 0, blocks / num_threads);
+            for (auto& thread : threads) thread.join();
+        }
+
+        for (int p = 0; p < count; ++p) {
+            GraphPacket& packet = out[p];
+            packet.sender_id = (first_sender - 1 + p) % num_nodes + 1;
+            packet.edge_count = offsets[p + 1] - offsets[p];
+            GraphEdge* drawn = &edges[offsets[p]];
+
+            // A repeated pair moves on to the next free one instead of being redrawn.
+            // The filter keeps the usual no-repeat case at one well-predicted slot
+            // test per edge; only filter hits scan the packet's earlier edges.
+            if (++filter_packet == 0) {
+                std::memset(pair_filter, 0, sizeof(pair_filter));
+                filter_packet = 1;
+            }
+            const uint16_t* slot = &filter_slots[offsets[p]];
+            for (uint32_t i = 0; i < packet.edge_count; ++i) {
+                uint32_t h = slot[i];
+                if (__builtin_expect(pair_filter[h] == filter_packet, 0)) h = dedupe(drawn, i);
+                pair_filter[h] = filter_packet;
+            }
+            std::memcpy(packet.edges, drawn, packet.edge_count * sizeof(GraphEdge));
+        }
+    }
+
+    // Generates graphs for the listed senders only. Random graphs do not depend
+    // on the sender, so they are drawn as one batch; evolving edge sets are copied
+    // out, and the others stay untouched in the slots.
+    void generateSelected(const uint16_t* senders, int count, GraphPacket* out) {
+        if (model == GraphModel::Evolving) {
+            for (int p = 0; p < count; ++p) copyEdgeSet(senders[p], out[p]);
+            return;
+        }
+        if (count) generateGraphs(1, count, out);
+        for (int p = 0; p < count; ++p) out[p].sender_id = senders[p];
+    }
+
+    GraphPacket generateGraph(uint16_t sender_id) {
+        GraphPacket packet;
+        generateGraphs(sender_id, 1, &packet);
+        return packet;
+    }
+};
+
+// Tracks the live simulation state for checkpoints. Server threads hold the
+// state lock only while they change their state, so a checkpoint can fork a
+// consistent copy between two changes and write it from the child while the
+// ticks carry on (the way Redis saves in the background).
+class Checkpointer {
+private:
+    std::mutex state_lock;
+    NodeManager* nodes = nullptr;
+    GraphGenerator* graphs = nullptr;
+    std::unique_ptr<CheckpointFile> restore_from;
+    std::string path, tmp_path;
+    bool final_written = false;
+
+    // Writes the attached state to path via a temporary file and a rename. Runs
+    // in the forked child too, so it must not allocate.
+    bool write() const {
+#ifndef _WIN32
+        int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        CheckpointWriter out(fd);
+        if (nodes) nodes->checkpoint(out);
+        if (graphs) graphs->checkpoint(out);
+        bool ok = out.finish() && fdatasync(fd) == 0;
+        ok = close(fd) == 0 && ok;
+        return ok && rename(tmp_path.c_str(), path.c_str()) == 0;
+#else
+        return false;
+#endif
+    }
+
+    template <typename State>
+    void attachState(State* state, State*& slot) {
+        std::lock_guard<std::mutex> guard(state_lock);
+        if (restore_from) state->restore(*restore_from);
+        slot = state;
+        if (nodes && graphs) restore_from.reset(); // both restored, release the mapping
+    }
+
+    template <typename State>
+    void detachState(State*& slot) {
+        std::lock_guard<std::mutex> guard(state_lock);
+        // the first server to stop saves everything once more, while all state is still there
+        if (!running && enabled() && !final_written) {
+            final_written = true;
+            std::cout << (write() ? "Final checkpoint written to " : "Final checkpoint failed: ") << path << "\n";
+        }
+        slot = nullptr;
+    }
+
+public:
+    // Attaches a server's state for the lifetime of the scope, restoring it first
+    // when the announcer starts from a checkpoint.
+    template <typename State>
+    class Attached {
+    private:
+        Checkpointer& owner;
+        State* state;
+
+    public:
+        Attached(Checkpointer& owner, State* state) : owner(owner), state(state) { owner.attach(state); }
+        ~Attached() { owner.detach(state); }
+    };
+
+    std::mutex& stateLock() { return state_lock; }
+
+    void enable(const std::string& checkpoint_path) {
+        path = checkpoint_path;
+        tmp_path = path + ".tmp";
+    }
+
+    bool enabled() const { return !path.empty(); }
+
+    void restoreFrom(const std::string& restore_path) { restore_from.reset(new CheckpointFile(restore_path)); }
+    const CheckpointFile* restorePoint() const { return restore_from.get(); }
+
+    void attach(NodeManager* nodeManager) { attachState(nodeManager, nodes); }
+    void attach(GraphGenerator* graphGen) { attachState(graphGen, graphs); }
+    void detach(NodeManager*) { detachState(nodes); }
+    void detach(GraphGenerator*) { detachState(graphs); }
+
+    // Forks under the state lock, so the ticks wait only for the fork itself, and
+    // lets the child write the copy.
+    void snapshot() {
+#ifndef _WIN32
+        auto start = std::chrono::steady_clock::now();
+        pid_t pid;
+        {
+            std::lock_guard<std::mutex> guard(state_lock);
+            pid = fork();
+            if (pid == 0) _exit(write() ? 0 : 1);
+        }
+        auto paused = std::chrono::steady_clock::now() - start;
+        if (pid < 0) throw std::runtime_error(std::string("fork failed: ") + strerror(errno));
+
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        struct stat st;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && stat(path.c_str(), &st) == 0) {
+            std::cout << "Checkpoint written to " << path << ": " << st.st_size / 1024 << " KiB in "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms, ticks held "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(paused).count() << " us for the fork\n";
+        } else {
+            std::cerr << "Checkpoint to " << path << " failed\n";
+        }
+#else
+        std::lock_guard<std::mutex> guard(state_lock);
+        if (!write()) std::cerr << "Checkpoint to " << path << " failed\n";
+#endif
+    }
+};
+
+Checkpointer checkpointer;
+
+// Latest positions and per-sender graphs, shared between the server threads so
+// that consumers such as the routing simulator can work on the live topology.
+class Topology {
+private:
+    static constexpr size_t PACKET_EDGES = sizeof(GraphPacket::edges) / sizeof(GraphEdge);
+
+    // A published edge: edge of the graph of sender_id.
+    struct EdgeRef {
+        uint16_t sender_id;
+        uint16_t edge;
+    };
+
+    std::vector<std::pair<float, float>> positions; // indexed by node id
+    std::vector<GraphPacket> graphs;                // indexed by sender id
+    uint64_t positions_version = 0;                 // bumped on every position publish
+
+    // Reverse edge index: the published edges into every node, so inbound queries
+    // cost O(in-degree). Each edge also remembers its place in its target's list
+    // (PACKET_EDGES places per sender), so replacing a sender's graph only touches
+    // that graph's edges.
+    std::vector<std::vector<EdgeRef>> inbound; // indexed by target id
+    std::vector<uint32_t> inbound_place;       // indexed by sender id * PACKET_EDGES + edge
+
+    bool indexed(uint16_t target_id) const { return target_id >= 1 && target_id < inbound.size(); }
+
+    void link(uint16_t sender_id, uint16_t edge) {
+        uint16_t target_id = graphs[sender_id].edges[edge].target_id;
+        if (!indexed(target_id)) return;
+        inbound_place[sender_id * PACKET_EDGES + edge] = inbound[target_id].size();
+        inbound[target_id].push_back({sender_id, edge});
+    }
+
+    void unlink(uint16_t sender_id, uint16_t edge) {
+        uint16_t target_id = graphs[sender_id].edges[edge].target_id;
+        if (!indexed(target_id)) return;
+        std::vector<EdgeRef>& refs = inbound[target_id];
+        uint32_t place = inbound_place[sender_id * PACKET_EDGES + edge];
+        EdgeRef last = refs.back();
+        refs[place] = last;
+        inbound_place[last.sender_id * PACKET_EDGES + last.edge] = place;
+        refs.pop_back();
+    }
+
+public:
+    Topology() { resize(NUM_NODES); }
+
+    void resize(int num_nodes) {
+        std::lock_guard<std::mutex> guard(lock);
+        positions.assign(num_nodes + 1, {0.0f, 0.0f});
+        graphs.resize(num_nodes + 1);
+        for (size_t i = 0; i < graphs.size(); ++i) {
+            graphs[i].sender_id = i;
+            graphs[i].edge_count = 0;
+        }
+        inbound.assign(num_nodes + 1, {});
+        inbound_place.assign((num_nodes + 1) * PACKET_EDGES, 0);
+    }
+
+    void publishPositions(const NodeManager& nodeManager) {
+        std::lock_guard<std::mutex> guard(lock);
+        for (uint16_t node_id : nodeManager.getNodeIds()) {
+            positions[node_id] = nodeManager.getPosition(node_id);
+        }
+        positions_version++;
+    }
+
+    void publishGraph(const GraphPacket& packet) {
+        std::lock_guard<std::mutex> guard(lock);
+        uint16_t sender_id = packet.sender_id;
+        if (sender_id >= graphs.size()) return;
+        for (uint16_t e = 0; e < graphs[sender_id].edge_count; ++e) unlink(sender_id, e);
+        graphs[sender_id] = packet;
+        graphs[sender_id].edge_count = std::min<size_t>(packet.edge_count, PACKET_EDGES);
+        for (uint16_t e = 0; e < graphs[sender_id].edge_count; ++e) link(sender_id, e);
+    }
+
+    // The published edges into node_id, in no particular order.
+    void inboundEdges(uint16_t node_id, std::vector<InboundEdge>& out) const {
+        std::lock_guard<std::mutex> guard(lock);
+        out.clear();
+        if (!indexed(node_id)) return;
+        for (const EdgeRef& ref : inbound[node_id]) {
+            const GraphEdge& edge = graphs[ref.sender_id].edges[ref.edge];
+            out.push_back({ref.sender_id, edge.source_id, edge.strength});
+        }
+    }
+
+    // Copies the positions only if they were published since the given version.
+    bool positionsSince(uint64_t& version, std::vector<std::pair<float, float>>& positions_out) const {
+        std::lock_guard<std::mutex> guard(lock);
+        if (version == positions_version) return false;
+        version = positions_version;
+        positions_out = positions;
+        return true;
+    }
+
+    void snapshot(std::vector<std::pair<float, float>>& positions_out, std::vector<GraphPacket>& graphs_out) const {
+        std::lock_guard<std::mutex> guard(lock);
+        positions_out = positions;
+        graphs_out = graphs;
+    }
+};
+
+Topology topology;
+
+// Live graph interest of all subscribers, for lazy graph generation.
+class GraphInterest {
+private:
+    struct Subscriber {
+        sockaddr_in from;
+        uint8_t kind;
+        float x, y, radius;
+        std::vector<uint16_t> senders;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<Subscriber> subscribers;
+
+    static bool sameAddress(const sockaddr_in& a, const sockaddr_in& b) {
+        return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+    }
+
+public:
+    void update(const sockaddr_in& from, const InterestRequest& request, const uint16_t* senders) {
+        std::lock_guard<std::mutex> guard(mutex);
+        auto it = std::find_if(subscribers.begin(), subscribers.end(), [&](const Subscriber& s) { return sameAddress(s.from, from); });
+        if (!request.lease_ms) {
+            if (it != subscribers.end()) subscribers.erase(it);
+            return;
+        }
+        if (it == subscribers.end()) it = subscribers.insert(subscribers.end(), Subscriber{});
+        it->from = from;
+        it->kind = request.kind;
+        it->x = request.x;
+        it->y = request.y;
+        it->radius = request.radius;
+        it->senders.assign(senders, senders + (request.kind == INTEREST_SENDERS ? request.count : 0));
+        it->expires = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::min<uint32_t>(request.lease_ms, INTEREST_MAX_LEASE_MS));
+    }
+
+    // Drops expired leases, then calls want(sender_id) for every sender someone
+    // wants. Area interest is matched against positions (indexed by node id).
+    template <typename Want>
+    size_t collect(const std::vector<std::pair<float, float>>& positions, Want want) {
+        std::lock_guard<std::mutex> guard(mutex);
+        auto now = std::chrono::steady_clock::now();
+        subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(), [&](const Subscriber& s) { return s.expires <= now; }),
+                          subscribers.end());
+        for (const Subscriber& s : subscribers) {
+            if (s.kind == INTEREST_SENDERS) {
+                for (uint16_t sender_id : s.senders) want(sender_id);
+                continue;
+            }
+            float r2 = s.radius * s.radius;
+            for (size_t id = 1; id < positions.size(); ++id) {
+                float dx = positions[id].first - s.x, dy = positions[id].second - s.y;
+                if (dx * dx + dy * dy <= r2) want(id);
+            }
+        }
+        return subscribers.size();
+    }
+
+    bool wantsAreas() const {
+        std::lock_guard<std::mutex> guard(mutex);
+        return std::any_of(subscribers.begin(), subscribers.end(), [](const Subscriber& s) { return s.kind == INTEREST_AREA; });
+    }
+};
+
+GraphInterest interest;
+
+// A contiguous buffer that is part of an outgoing datagram.
+struct Segment {
+    const void* data;
+    size_t size;
+};
+
+// Sends one datagram gathered straight from the given buffers, without staging
+// them in a send buffer first.
+bool sendGather(SOCKET sock, const Segment* segments, size_t count, const sockaddr_in& to) {
+#ifdef _WIN32
+    WSABUF buffers[8];
+    for (size_t i = 0; i < count; ++i) {
+        buffers[i].buf = (char*)segments[i].data;
+        buffers[i].len = (ULONG)segments[i].size;
+    }
+    DWORD sent = 0;
+    return WSASendTo(sock, buffers, (DWORD)count, &sent, 0, (const sockaddr*)&to, sizeof(to), nullptr, nullptr) == 0;
+#else
+    iovec iov[8];
+    for (size_t i = 0; i < count; ++i) {
+        iov[i].iov_base = (void*)segments[i].data;
+        iov[i].iov_len = segments[i].size;
+    }
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void*)&to;
+    msg.msg_namelen = sizeof(to);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    return sendmsg(sock, &msg, 0) >= 0;
+#endif
+}
+
+// Recent positions of every node, recorded once per position tick. All nodes
+// are recorded on the same ticks, so one ring of tick times is shared and each
+// node only keeps its points: one slab of num_nodes x length points, node n's
+// ring at [(n - 1) * length, n * length). Memory never grows past that.
+class PositionHistory {
+public:
+    struct Point {
+        float x;
+        float y;
+    };
+
+private:
+    // The rings' own lock rather than the global one: trail replies are sent
+    // straight out of the rings with the lock held, and only record() waits on it.
+    std::mutex mutex;
+    size_t length = 0;
+    uint64_t written = 0;       // ticks recorded so far
+    std::vector<int64_t> times; // tick time ring
+    std::vector<Point> slab;
+
+public:
+    void resize(int num_nodes, size_t history_length) {
+        std::lock_guard<std::mutex> guard(mutex);
+        length = history_length;
+        written = 0;
+        times.assign(length, 0);
+        slab.assign((size_t)num_nodes * length, Point{0.0f, 0.0f});
+    }
+
+    size_t bytes() const {
+        return times.size() * sizeof(int64_t) + slab.size() * sizeof(Point);
+    }
+
+    void record(const NodeManager& nodeManager, int64_t now) {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (!length) return;
+        size_t slot = written % length;
+        times[slot] = now;
+        for (uint16_t node_id : nodeManager.getNodeIds()) {
+            auto pos = nodeManager.getPosition(node_id);
+            slab[(node_id - 1) * length + slot] = Point{pos.first, pos.second};
+        }
+        written++;
+    }
+
+    // Points out the reply for one node's trail since the given time: header,
+    // then the times and the points as they lie in the rings (each ring may wrap,
+    // so up to two pieces each). Returns the number of segments. The segments
+    // point into the rings, so they are only valid under the mutex (see sendTrail).
+    size_t trail(uint16_t node_id, int64_t since, TrailReplyHeader& header, Segment* segments) const {
+        size_t count = 0;
+        if (node_id >= 1 && (size_t)node_id * length <= slab.size()) {
+            size_t kept = std::min<uint64_t>(written, length);
+            while (count < kept && times[(written - count - 1) % length] >= since) count++;
+        }
+        header.node_id = node_id;
+        header.count = count;
+
+        size_t n = 0;
+        segments[n++] = Segment{&header, sizeof(header)};
+        if (!count) return n;
+        size_t first = (written - count) % length;
+        size_t head = std::min(count, length - first);
+        const Point* points = &slab[(node_id - 1) * length];
+        segments[n++] = Segment{&times[first], head * sizeof(int64_t)};
+        if (head < count) segments[n++] = Segment{&times[0], (count - head) * sizeof(int64_t)};
+        segments[n++] = Segment{&points[first], head * sizeof(Point)};
+        if (head < count) segments[n++] = Segment{&points[0], (count - head) * sizeof(Point)};
+        return n;
+    }
+
+    // Sends one node's trail reply to `to`, gathered straight from the rings.
+    void sendTrail(SOCKET sock, uint16_t node_id, int64_t since, TrailReplyHeader& header, const sockaddr_in& to) {
+        Segment segments[5];
+        std::lock_guard<std::mutex> guard(mutex);
+        size_t n = trail(node_id, since, header, segments);
+        sendGather(sock, segments, n, to);
+    }
+};
+
+PositionHistory history;
+
+// Load shedding steps, taken in this order while position ticks overrun their
+// budget and given back in reverse order once there is headroom again.
+enum class ShedLevel { None, DeferGraphs, CutRates, SkipExtras };
+
+// Tick-budget watchdog. The position server reports the work of each tick (its
+// sleeps excluded) against the configured tick period. After
+// WATCHDOG_OVERRUN_TICKS overrunning ticks in a row it sheds the next step;
+// after WATCHDOG_RECOVER_TICKS ticks below WATCHDOG_HEADROOM of the budget it
+// restores the last one. Phase costs are smoothed for the log.
+class TickWatchdog {
+public:
+    enum Phase { Move, Publish, Send, Graph, PHASES };
+
+private:
+    std::mutex mutex;
+    std::atomic<int> shed{(int)ShedLevel::None};
+    double phase_ms[PHASES] = {};
+    int over = 0;  // consecutive overrunning ticks
+    int under = 0; // consecutive ticks with headroom
+    uint64_t overruns = 0;
+    std::atomic<uint64_t> deferred_graphs{0}, cut_sends{0}, skipped_extras{0};
+
+    static const char* stepName(int level) {
+        static const char* names[] = {"", "graph generation", "unchanged position refreshes", "history and metrics"};
+        return names[level];
+    }
+
+    void log(const char* what, double work_ms, double budget_ms, int level) {
+        std::cout << "Watchdog: tick work " << work_ms << " ms of " << budget_ms << " ms budget (move " << phase_ms[Move]
+                  << ", publish " << phase_ms[Publish] << ", send " << phase_ms[Send] << " ms, graph rounds "
+                  << phase_ms[Graph] << " ms), " << what << " " << stepName(level) << "\n";
+    }
+
+public:
+    ShedLevel level() const { return (ShedLevel)shed.load(std::memory_order_relaxed); }
+    bool shedding(ShedLevel step) const { return shed.load(std::memory_order_relaxed) >= (int)step; }
+
+    void record(Phase phase, int64_t ns) {
+        std::lock_guard<std::mutex> guard(mutex);
+        phase_ms[phase] = 0.8 * phase_ms[phase] + 0.2 * ns / 1e6;
+    }
+
+    void endTick(double work_ms, double budget_ms) {
+        std::lock_guard<std::mutex> guard(mutex);
+        int level = shed;
+        if (work_ms > budget_ms) {
+            overruns++;
+            under = 0;
+            if (++over >= WATCHDOG_OVERRUN_TICKS && level < (int)ShedLevel::SkipExtras) {
+                shed = ++level;
+                over = 0;
+                log("shedding", work_ms, budget_ms, level);
+            }
+        } else if (work_ms < WATCHDOG_HEADROOM * budget_ms) {
+            over = 0;
+            if (++under >= WATCHDOG_RECOVER_TICKS && level > (int)ShedLevel::None) {
+                shed = level - 1;
+                under = 0;
+                log("headroom back, restoring", work_ms, budget_ms, level);
+            }
+        } else {
+            over = under = 0;
+        }
+    }
+
+    void deferredGraphRound() { deferred_graphs++; }
+    void cutSends(uint64_t count) { cut_sends += count; }
+    void skippedExtras() { skipped_extras++; }
+
+    void report() {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (!overruns) return;
+        std::cout << "Watchdog: " << overruns << " overrunning ticks, " << deferred_graphs << " graph rounds deferred, "
+                  << cut_sends << " position sends cut, history and metrics skipped " << skipped_extras << " times\n";
+    }
+};
+
+TickWatchdog watchdog;
+
+int64_t elapsedNs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Uniform grid over the world, about two nodes per cell, stored CSR style: the
+// entries of cell c are [cell_start[c], cell_start[c + 1]) in ids/xs/ys. Queries
+// return entry indices.
+class SpatialIndex {
+private:
+    int side = 1;
+    float cell_size = WORLD_SIZE;
+    std::vector<uint32_t> cell_start;
+    std::vector<uint16_t> ids;
+    std::vector<float> xs, ys;
+
+    // Query coordinates come from clients, so the cell is clamped before the
+    // cast: anything off the grid, infinities included, lands on its edge and
+    // NaN on cell 0.
+    int cellOf(float v) const {
+        float cell = v / cell_size;
+        if (!(cell > 0)) return 0;
+        return cell >= side - 1 ? side - 1 : (int)cell;
+    }
+
+    template <typename Visit>
+    void visitCells(int cx0, int cy0, int cx1, int cy1, Visit visit) const {
+        for (int cy = std::max(0, cy0); cy <= std::min(side - 1, cy1); ++cy) {
+            for (int cx = std::max(0, cx0); cx <= std::min(side - 1, cx1); ++cx) {
+                int c = cy * side + cx;
+                for (uint32_t e = cell_start[c]; e < cell_start[c + 1]; ++e) visit(e);
+            }
+        }
+    }
+
+    float dist2(uint32_t e, float x, float y) const {
+        float dx = xs[e] - x;
+        float dy = ys[e] - y;
+        return dx*dx + dy*dy;
+    }
+
+public:
+    // positions are indexed by node id, entry 0 unused
+    void build(const std::vector<std::pair<float, float>>& positions) {
+        size_t n = positions.size() > 1 ? positions.size() - 1 : 0;
+        side = std::max(1, (int)std::ceil(std::sqrt(n / 2.0)));
+        cell_size = WORLD_SIZE / side;
+        cell_start.assign(side * side + 1, 0);
+        for (size_t i = 1; i <= n; ++i) {
+            cell_start[cellOf(positions[i].second) * side + cellOf(positions[i].first) + 1]++;
+        }
+        for (size_t c = 1; c < cell_start.size(); ++c) cell_start[c] += cell_start[c - 1];
+
+        ids.resize(n);
+        xs.resize(n);
+        ys.resize(n);
+        std::vector<uint32_t> fill(cell_start.begin(), cell_start.end() - 1);
+        for (size_t i = 1; i <= n; ++i) {
+            uint32_t e = fill[cellOf(positions[i].second) * side + cellOf(positions[i].first)]++;
+            ids[e] = i;
+            xs[e] = positions[i].first;
+            ys[e] = positions[i].second;
+        }
+    }
+
+    uint16_t id(uint32_t e) const { return ids[e]; }
+    float x(uint32_t e) const { return xs[e]; }
+    float y(uint32_t e) const { return ys[e]; }
+
+    void range(float x, float y, float radius, std::vector<uint32_t>& out) const {
+        out.clear();
+        float r2 = radius * radius;
+        visitCells(cellOf(x - radius), cellOf(y - radius), cellOf(x + radius), cellOf(y + radius), [&](uint32_t e) {
+            if (dist2(e, x, y) <= r2) out.push_back(e);
+        });
+    }
+
+    void box(float x0, float y0, float x1, float y1, std::vector<uint32_t>& out) const {
+        out.clear();
+        if (x0 > x1 || y0 > y1) return;
+        visitCells(cellOf(x0), cellOf(y0), cellOf(x1), cellOf(y1), [&](uint32_t e) {
+            if (xs[e] >= x0 && xs[e] <= x1 && ys[e] >= y0 && ys[e] <= y1) out.push_back(e);
+        });
+    }
+
+    // Searches rings of cells outward from the query cell until no unvisited cell
+    // can hold anything closer than the current k-th nearest.
+    void nearest(float x, float y, size_t k, std::vector<uint32_t>& out) const {
+        out.clear();
+        k = std::min(k, ids.size());
+        if (!k) return;
+        std::vector<std::pair<float, uint32_t>> heap; // max-heap on distance
+        heap.reserve(k + 1);
+        auto consider = [&](uint32_t e) {
+            float d = dist2(e, x, y);
+            if (heap.size() < k) {
+                heap.push_back({d, e});
+                std::push_heap(heap.begin(), heap.end());
+            } else if (d < heap.front().first) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.back() = {d, e};
+                std::push_heap(heap.begin(), heap.end());
+            }
+        };
+        int cx = cellOf(x), cy = cellOf(y);
+        for (int ring = 0; ring < side; ++ring) {
+            // everything in this ring is at least (ring - 1) cells away from a
+            // point in the center cell, or from its clamp onto the world
+            float reach = std::max(0, ring - 1) * cell_size;
+            if (heap.size() == k && reach * reach > heap.front().first) break;
+            if (ring == 0) {
+                visitCells(cx, cy, cx, cy, consider);
+                continue;
+            }
+            visitCells(cx - ring, cy - ring, cx + ring, cy - ring, consider);
+            visitCells(cx - ring, cy + ring, cx + ring, cy + ring, consider);
+            visitCells(cx - ring, cy - ring + 1, cx - ring, cy + ring - 1, consider);
+            visitCells(cx + ring, cy - ring + 1, cx + ring, cy + ring - 1, consider);
+        }
+        std::sort_heap(heap.begin(), heap.end());
+        for (auto& [d, e] : heap) out.push_back(e);
+    }
+};
+
+struct RoutingReport {
+    uint64_t queries = 0;
+    uint64_t reachable = 0;     // a path exists at all
+    uint64_t delivered = 0;
+    double stretch_sum = 0;     // sum of hops / shortest hops over delivered queries
+    std::vector<uint64_t> drops; // per node id, where undelivered messages died
+};
+
+// Geographic greedy routing with GPSR-style perimeter recovery over the union of
+// all senders' edges, using the node positions of the same snapshot.
+class RoutingSimulator {
+private:
+    int num_nodes = 0;
+    std::vector<float> xs, ys;              // indexed by node id
+    std::vector<uint32_t> offsets;          // CSR adjacency, indexed by node id
+    std::vector<uint16_t> neighbors;
+    std::vector<uint32_t> planar_offsets;   // Gabriel-planarized adjacency,
+    std::vector<uint16_t> planar_neighbors; // sorted counterclockwise by bearing
+    std::vector<float> planar_angles;
+
+    float dist2(uint16_t a, float x, float y) const {
+        float dx = xs[a] - x;
+        float dy = ys[a] - y;
+        return dx*dx + dy*dy;
+    }
+
+    float bearing(uint16_t from, uint16_t to) const {
+        return std::atan2(ys[to] - ys[from], xs[to] - xs[from]);
+    }
+
+    // First planar neighbor of node strictly counterclockwise from the given bearing.
+    uint16_t nextCounterClockwise(uint16_t node, float angle) const {
+        uint32_t begin = planar_offsets[node], end = planar_offsets[node + 1];
+        if (begin == end) return 0;
+        auto it = std::upper_bound(planar_angles.begin() + begin, planar_angles.begin() + end, angle);
+        uint32_t idx = it == planar_angles.begin() + end ? begin : it - planar_angles.begin();
+        return planar_neighbors[idx];
+    }
+
+    // Where segment a-b crosses segment p-q, if it does.
+    static bool crossing(float ax, float ay, float bx, float by, float px, float py, float qx, float qy,
+                         float& cx, float& cy) {
+        float rx = bx - ax, ry = by - ay;
+        float sx = qx - px, sy = qy - py;
+        float denom = rx * sy - ry * sx;
+        if (std::fabs(denom) < 1e-9f) return false;
+        float t = ((px - ax) * sy - (py - ay) * sx) / denom;
+        float u = ((px - ax) * ry - (py - ay) * rx) / denom;
+        if (t <= 0.0f || t >= 1.0f || u < 0.0f || u > 1.0f) return false;
+        cx = ax + t * rx;
+        cy = ay + t * ry;
+        return true;
+    }
+
+    void bfs(uint16_t source, std::vector<uint16_t>& hops, std::vector<uint16_t>& queue) const {
+        std::fill(hops.begin(), hops.end(), UINT16_MAX);
+        queue.clear();
+        hops[source] = 0;
+        queue.push_back(source);
+        for (size_t head = 0; head < queue.size(); ++head) {
+            uint16_t u = queue[head];
+            for (uint32_t e = offsets[u]; e < offsets[u + 1]; ++e) {
+                uint16_t v = neighbors[e];
+                if (hops[v] == UINT16_MAX) {
+                    hops[v] = hops[u] + 1;
+                    queue.push_back(v);
+                }
+            }
+        }
+    }
+
+public:
+    void build(const std::vector<std::pair<float, float>>& positions, const std::vector<GraphPacket>& graphs) {
+        num_nodes = positions.size() - 1;
+        xs.assign(num_nodes + 1, 0.0f);
+        ys.assign(num_nodes + 1, 0.0f);
+        for (int i = 1; i <= num_nodes; ++i) {
+            xs[i] = positions[i].first;
+            ys[i] = positions[i].second;
+        }
+
+        // links are bidirectional for routing purposes; dedupe over all senders
+        std::vector<uint32_t> links;
+        for (const GraphPacket& graph : graphs) {
+            for (int i = 0; i < graph.edge_count; ++i) {
+                uint16_t a = graph.edges[i].source_id, b = graph.edges[i].target_id;
+                if (a == b || a < 1 || b < 1 || a > num_nodes || b > num_nodes) continue;
+                links.push_back((uint32_t)a << 16 | b);
+                links.push_back((uint32_t)b << 16 | a);
+            }
+        }
+        std::sort(links.begin(), links.end());
+        links.erase(std::unique(links.begin(), links.end()), links.end());
+
+        offsets.assign(num_nodes + 2, 0);
+        neighbors.resize(links.size());
+        for (uint32_t link : links) offsets[(link >> 16) + 1]++;
+        for (int i = 1; i <= num_nodes + 1; ++i) offsets[i] += offsets[i - 1];
+        for (size_t i = 0; i < links.size(); ++i) neighbors[i] = links[i] & 0xFFFF;
+
+        // Gabriel graph: drop u-v if a neighbor of either end lies inside the circle on u-v
+        planar_offsets.assign(num_nodes + 2, 0);
+        planar_neighbors.clear();
+        planar_angles.clear();
+        std::vector<std::pair<float, uint16_t>> kept;
+        for (int u = 1; u <= num_nodes; ++u) {
+            kept.clear();
+            for (uint32_t e = offsets[u]; e < offsets[u + 1]; ++e) {
+                uint16_t v = neighbors[e];
+                float uv = dist2(u, xs[v], ys[v]);
+                bool gabriel = true;
+                for (uint16_t end : {(uint16_t)u, v}) {
+                    for (uint32_t f = offsets[end]; gabriel && f < offsets[end + 1]; ++f) {
+                        uint16_t w = neighbors[f];
+                        if (w != u && w != v && dist2(w, xs[u], ys[u]) + dist2(w, xs[v], ys[v]) < uv) gabriel = false;
+                    }
+                }
+                if (gabriel) kept.push_back({bearing(u, v), v});
+            }
+            std::sort(kept.begin(), kept.end());
+            for (auto& [angle, v] : kept) {
+                planar_angles.push_back(angle);
+                planar_neighbors.push_back(v);
+            }
+            planar_offsets[u + 1] = planar_neighbors.size();
+        }
+    }
+
+    // Routes one message. Returns 0 when delivered, otherwise the node where it was dropped.
+    uint16_t route(uint16_t source, uint16_t destination, int& hops) const {
+        const float dx = xs[destination], dy = ys[destination];
+        const int ttl = 4 * num_nodes + 16;
+        uint16_t prev = 0, cur = source;
+        bool perimeter = false;
+        float entry_d2 = 0, face_x = 0, face_y = 0;
+        uint16_t first_from = 0, first_to = 0;
+
+        for (hops = 0; hops < ttl; ++hops) {
+            if (cur == destination) return 0;
+            float cur_d2 = dist2(cur, dx, dy);
+            if (perimeter && cur_d2 < entry_d2) perimeter = false;
+
+            uint16_t next = 0;
+            if (!perimeter) {
+                float best = cur_d2;
+                for (uint32_t e = offsets[cur]; e < offsets[cur + 1]; ++e) {
+                    float d = dist2(neighbors[e], dx, dy);
+                    if (d < best) {
+                        best = d;
+                        next = neighbors[e];
+                    }
+                }
+                if (!next) {
+                    // local minimum: walk the face intersected by the line towards the destination
+                    perimeter = true;
+                    entry_d2 = cur_d2;
+                    face_x = xs[cur];
+                    face_y = ys[cur];
+                    next = nextCounterClockwise(cur, std::atan2(dy - ys[cur], dx - xs[cur]));
+                    if (!next) return cur;
+                    first_from = cur;
+                    first_to = next;
+                }
+            } else {
+                next = nextCounterClockwise(cur, bearing(cur, prev));
+                float cx, cy;
+                bool changed_face = false;
+                for (uint32_t tries = planar_offsets[cur + 1] - planar_offsets[cur]; tries > 0; --tries) {
+                    if (!crossing(xs[cur], ys[cur], xs[next], ys[next], face_x, face_y, dx, dy, cx, cy)) break;
+                    float face_d2 = (face_x - dx) * (face_x - dx) + (face_y - dy) * (face_y - dy);
+                    if ((cx - dx) * (cx - dx) + (cy - dy) * (cy - dy) >= face_d2) break;
+                    // the edge leaves the current face closer to the destination: switch faces
+                    face_x = cx;
+                    face_y = cy;
+                    next = nextCounterClockwise(cur, bearing(cur, next));
+                    first_from = cur;
+                    first_to = next;
+                    changed_face = true;
+                }
+                // back on the first edge of this face: the destination is unreachable by perimeter
+                if (!changed_face && cur == first_from && next == first_to) return cur;
+            }
+            prev = cur;
+            cur = next;
+        }
+        return cur == destination ? 0 : cur;
+    }
+
+    // Routes `queries` random source/destination pairs spread over `num_threads` threads.
+    RoutingReport run(uint64_t queries, unsigned num_threads, std::mt19937& gen) const {
+        RoutingReport total;
+        total.drops.assign(num_nodes + 1, 0);
+        if (num_nodes < 2) return total;
+        num_threads = std::max(1u, std::min<unsigned>(num_threads, num_nodes));
+
+        std::vector<RoutingReport> reports(num_threads);
+        std::vector<uint32_t> seeds(num_threads);
+        for (auto& seed : seeds) seed = gen();
+
+        auto worker = [&](unsigned t) {
+            RoutingReport& report = reports[t];
+            report.drops.assign(num_nodes + 1, 0);
+            std::mt19937 local(seeds[t]);
+            std::uniform_int_distribution<int> dest_dist(1, num_nodes - 1);
+            std::vector<uint16_t> shortest(num_nodes + 1), queue;
+            queue.reserve(num_nodes);
+
+            // queries are grouped by source so each thread runs one BFS per source it owns
+            for (int source = 1 + t; source <= num_nodes; source += num_threads) {
+                uint64_t count = queries / num_nodes + ((uint64_t)source <= queries % num_nodes ? 1 : 0);
+                if (!count) continue;
+                bfs(source, shortest, queue);
+                for (uint64_t q = 0; q < count; ++q) {
+                    int destination = dest_dist(local);
+                    if (destination >= source) ++destination;
+                    report.queries++;
+                    if (shortest[destination] == UINT16_MAX) continue;
+                    report.reachable++;
+                    int hops;
+                    uint16_t dropped_at = route(source, destination, hops);
+                    if (dropped_at) {
+                        report.drops[dropped_at]++;
+                    } else {
+                        report.delivered++;
+                        report.stretch_sum += (double)hops / shortest[destination];
+                    }
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned t = 1; t < num_threads; ++t) threads.emplace_back(worker, t);
+        worker(0);
+        for (auto& thread : threads) thread.join();
+
+        for (const RoutingReport& report : reports) {
+            total.queries += report.queries;
+            total.reachable += report.reachable;
+            total.delivered += report.delivered;
+            total.stretch_sum += report.stretch_sum;
+            for (int i = 1; i <= num_nodes; ++i) total.drops[i] += report.drops[i];
+        }
+        return total;
+    }
+};
+
+void positionServer(const Options& options, EndpointPool* endpoints, ShmRegion* shm) {
+    try {
+        std::unique_ptr<Transport> transport = openTransport(options, 12345, "node-positions.sock", SHM_POSITIONS, endpoints, shm);
+        NodeManager nodeManager(options.num_nodes);
+        if (options.fixed_point) nodeManager.useFixedPoint(options.fixed_seed);
+        Checkpointer::Attached<NodeManager> attached(checkpointer, &nodeManager);
+        std::vector<EndpointDatagram> batch;
+        std::shared_ptr<const RuntimeConfig> config;
+        std::vector<std::pair<float, float>> last_sent(options.num_nodes + 1, {-1.0f, -1.0f});
+        uint64_t round = 0;
+        
+        std::cout << "Position server started on " << transport->name() << "\n";
+        
+        // While shedding, nodes that have not moved since their last send are
+        // the low-priority entities: they only go out every REFRESH_EVERY rounds.
+        auto due = [&](uint16_t node_id, std::pair<float, float> pos) {
+            if (node_id >= last_sent.size()) last_sent.resize(node_id + 1, {-1.0f, -1.0f});
+            if (!watchdog.shedding(ShedLevel::CutRates) || pos != last_sent[node_id] || (node_id + round) % REFRESH_EVERY == 0) {
+                last_sent[node_id] = pos;
+                return true;
+            }
+            return false;
+        };
+
+        while (running) {
+            round++;
+            // tick boundary: a reloaded config takes effect from this round on
+            std::shared_ptr<const RuntimeConfig> latest = currentConfig();
+            if (latest != config) {
+                config = latest;
+                std::lock_guard<std::mutex> guard(checkpointer.stateLock());
+                nodeManager.setMoveDistance(config->move_distance);
+                global_send_limit.setRate(config->global_rate, config->rate_burst_ms);
+                int granted = transport->configure(*config, config->position_rate, config->position_high_priority);
+                if (config->send_buffer) std::cout << "Position stream send buffer: " << granted << " bytes\n";
+            }
+            auto tick_start = std::chrono::steady_clock::now();
+            {
+                std::lock_guard<std::mutex> guard(checkpointer.stateLock());
+                nodeManager.updatePositions();
+            }
+            watchdog.record(TickWatchdog::Move, elapsedNs(tick_start));
+            auto phase_start = std::chrono::steady_clock::now();
+            topology.publishPositions(nodeManager);
+            if (shm) {
+                ShmPoint* points = shm->beginSnapshot();
+                for (uint16_t node_id : nodeManager.getNodeIds()) {
+                    auto pos = nodeManager.getPosition(node_id);
+                    points[node_id] = ShmPoint{pos.first, pos.second};
+                }
+                shm->endSnapshot(round, announcerClockNs());
+            }
+            if (!watchdog.shedding(ShedLevel::SkipExtras)) {
+                history.record(nodeManager, announcerClockNs());
+                if (nodeManager.fixedPoint() && nodeManager.ticks() % 100 == 0) {
+                    // same seed and tick, same digest, whatever the build
+                    std::cout << "Tick " << nodeManager.ticks() << " position digest " << std::hex << nodeManager.digest() << std::dec << "\n";
+                }
+            } else {
+                watchdog.skippedExtras();
+            }
+            watchdog.record(TickWatchdog::Publish, elapsedNs(phase_start));
+            phase_start = std::chrono::steady_clock::now();
+            int64_t slept_ns = 0;
+            uint64_t cut = 0;
+
+            // the tick goes out as one batch, or node by node where spacing applies
+            bool spaced = config->position_spacing_ms && transport->spaced();
+            batch.resize(nodeManager.getNodeIds().size());
+            size_t n = 0;
+            for (uint16_t node_id : nodeManager.getNodeIds()) {
+                auto pos = nodeManager.getPosition(node_id);
+                if (!due(node_id, pos)) {
+                    cut++;
+                    continue;
+                }
+                batch[n].node_id = node_id;
+                batch[n].size = packPosition(node_id, pos, batch[n].data);
+                batch[n].size = appendTrailers(options, batch[n].data, batch[n].size);
+                n++;
+                if (spaced) {
+                    transport->sendBatch(batch.data(), n);
+                    n = 0;
+                    auto sleep_start = std::chrono::steady_clock::now();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(config->position_spacing_ms));
+                    slept_ns += elapsedNs(sleep_start);
+                }
+            }
+            if (n) transport->sendBatch(batch.data(), n);
+            transport->flush();
+            // the tick's work, spacing sleeps excluded, against the tick period
+            watchdog.record(TickWatchdog::Send, elapsedNs(phase_start) - slept_ns);
+            if (cut) watchdog.cutSends(cut);
+            watchdog.endTick((elapsedNs(tick_start) - slept_ns) / 1e6, config->position_interval_ms);
+            
+            std::this_thread::sleep_for(std::chrono::milliseconds(config->position_interval_ms));
+        }
+
+        transport->report("Position stream");
+        watchdog.report();
+        std::cout << "Position server stopped.\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Position server error: " << e.what() << std::endl;
+    }
+}
+
+void graphServer(const Options& options, EndpointPool* endpoints, ShmRegion* shm) {
+    try {
+        std::unique_ptr<Transport> transport = openTransport(options, 12346, "node-graphs.sock", SHM_GRAPHS, endpoints, shm);
+        std::shared_ptr<const RuntimeConfig> config = currentConfig();
+        GraphGenerator graphGen(options.num_nodes, config->min_edges, config->max_edges, options.graph_model);
+        transport->configure(*config, config->graph_rate, config->graph_high_priority);
+        Checkpointer::Attached<GraphGenerator> attached(checkpointer, &graphGen);
+        std::vector<EndpointDatagram> batch;
+        std::vector<GraphPacket> packets;
+
+        // --lazy-graphs: per round, only keyframes and senders someone wants
+        int keyframe_rounds = options.lazy_keyframe_rounds;
+        std::vector<uint16_t> selected;
+        std::vector<uint64_t> picked(options.num_nodes + 1, 0); // round each sender was last selected
+        std::vector<std::pair<float, float>> positions;
+        uint64_t positions_version = 0, round = 0, generated = 0, skipped = 0;
+        auto selectSenders = [&]() {
+            round++;
+            selected.clear();
+            auto pick = [&](size_t sender_id) {
+                if (sender_id < 1 || sender_id > (size_t)options.num_nodes || picked[sender_id] == round) return;
+                picked[sender_id] = round;
+                selected.push_back(sender_id);
+            };
+            // keyframes are staggered so every round carries an equal share
+            size_t first = (keyframe_rounds - round % keyframe_rounds) % keyframe_rounds;
+            for (size_t sender_id = first ? first : keyframe_rounds; sender_id <= (size_t)options.num_nodes; sender_id += keyframe_rounds) {
+                pick(sender_id);
+            }
+            if (interest.wantsAreas()) topology.positionsSince(positions_version, positions);
+            interest.collect(positions, pick);
+            std::sort(selected.begin(), selected.end());
+            generated += selected.size();
+            skipped += options.num_nodes - selected.size();
+        };
+        
+        std::cout << "Graph server started on " << transport->name();
+        if (keyframe_rounds) std::cout << ", lazy generation with keyframes every " << keyframe_rounds << " rounds";
+        std::cout << "\n";
+        
+        while (running) {
+            // tick boundary, as in positionServer
+            std::shared_ptr<const RuntimeConfig> latest = currentConfig();
+            if (latest != config) {
+                config = latest;
+                std::lock_guard<std::mutex> guard(checkpointer.stateLock());
+                graphGen.setEdgeRange(config->min_edges, config->max_edges);
+                global_send_limit.setRate(config->global_rate, config->rate_burst_ms);
+                int granted = transport->configure(*config, config->graph_rate, config->graph_high_priority);
+                if (config->send_buffer) std::cout << "Graph stream send buffer: " << granted << " bytes\n";
+            }
+            if (watchdog.shedding(ShedLevel::DeferGraphs)) {
+                // position ticks are overrunning: their consumers come first
+                watchdog.deferredGraphRound();
+                std::this_thread::sleep_for(std::chrono::milliseconds(config->graph_interval_ms));
+                continue;
+            }
+            auto round_start = std::chrono::steady_clock::now();
+            int64_t slept_ns = 0;
+            {
+                std::lock_guard<std::mutex> guard(checkpointer.stateLock());
+                graphGen.advance(); // one model tick per round
+            }
+            int count = options.num_nodes;
+            if (keyframe_rounds) {
+                selectSenders();
+                count = selected.size();
+            }
+            packets.resize(count);
+            {
+                std::lock_guard<std::mutex> guard(checkpointer.stateLock());
+                if (keyframe_rounds) {
+                    graphGen.generateSelected(selected.data(), count, packets.data());
+                } else {
+                    graphGen.generateGraphs(1, count, packets.data());
+                }
+            }
+
+            // the round goes out as one batch, or sender by sender where spacing applies
+            bool spaced = config->graph_spacing_ms && transport->spaced();
+            batch.resize(count);
+            size_t n = 0;
+            for (int p = 0; p < count; ++p) {
+                const GraphPacket& packet = packets[p];
+                topology.publishGraph(packet);
+                EndpointDatagram& datagram = batch[n++];
+                datagram.node_id = packet.sender_id;
+                datagram.size = graphPacketSize(packet);
+                std::memcpy(datagram.data, &packet, datagram.size);
+                datagram.size = appendTrailers(options, datagram.data, datagram.size);
+                if (spaced) {
+                    transport->sendBatch(batch.data(), n);
+                    n = 0;
+                    auto sleep_start = std::chrono::steady_clock::now();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(config->graph_spacing_ms));
+                    slept_ns += elapsedNs(sleep_start);
+                }
+            }
+            if (n) transport->sendBatch(batch.data(), n);
+            transport->flush();
+            watchdog.record(TickWatchdog::Graph, elapsedNs(round_start) - slept_ns);
+            
+            std::this_thread::sleep_for(std::chrono::milliseconds(config->graph_interval_ms));
+        }
+
+        transport->report("Graph stream");
+        if (keyframe_rounds && generated + skipped) {
+            std::cout << "Graph stream generated " << generated << " sender graphs on demand, left " << skipped << " pending ("
+                      << 100.0 * generated / (generated + skipped) << "% generated)\n";
+        }
+        std::cout << "Graph server stopped.\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Graph server error: " << e.what() << std::endl;
+    }
+}
+
+// Answers clock sync requests so receivers can map embedded send timestamps
+// onto their own clocks.
+void clockServer() {
+    try {
+        SOCKET sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sock == INVALID_SOCKET) throw std::runtime_error("Failed to create socket");
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(CLOCK_SYNC_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            closesocket(sock);
+            throw std::runtime_error("Failed to bind clock sync port");
+        }
+
+        // wake up periodically to notice shutdown
+#ifdef _WIN32
+        DWORD timeout = 200;
+#else
+        timeval timeout{0, 200000};
+#endif
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+
+        std::cout << "Clock sync server started on port " << CLOCK_SYNC_PORT << "\n";
+
+        while (running) {
+            ClockSyncPacket packet;
+            sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            int received = recvfrom(sock, (char*)&packet, sizeof(packet), 0, (sockaddr*)&from, &from_len);
+            int64_t t2 = announcerClockNs();
+            if (received != (int)sizeof(packet) || packet.magic != CLOCK_SYNC_MAGIC) continue;
+
+            packet.t2 = t2;
+            packet.t3 = announcerClockNs();
+            sendto(sock, (const char*)&packet, sizeof(packet), 0, (sockaddr*)&from, from_len);
+        }
+
+        closesocket(sock);
+        std::cout << "Clock sync server stopped.\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Clock sync server error: " << e.what() << std::endl;
+    }
+}
+
+// Answers trail queries from the position history and takes graph interest
+// updates. Trail replies are sent straight out of the history rings.
+void controlServer() {
+    try {
+        SOCKET sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sock == INVALID_SOCKET) throw std::runtime_error("Failed to create socket");
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(CONTROL_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            closesocket(sock);
+            throw std::runtime_error("Failed to bind control port");
+        }
+
+#ifdef _WIN32
+        DWORD timeout = 200;
+#else
+        timeval timeout{0, 200000};
+#endif
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+
+        std::cout << "Control server started on port " << CONTROL_PORT << "\n";
+
+        while (running) {
+            char request[sizeof(InterestRequest) + INTEREST_MAX_SENDERS * sizeof(uint16_t)];
+            sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            int received = recvfrom(sock, request, sizeof(request), 0, (sockaddr*)&from, &from_len);
+            if (received < (int)sizeof(uint32_t)) continue;
+            uint32_t magic;
+            std::memcpy(&magic, request, sizeof(magic));
+
+            if (magic == INTEREST_MAGIC && received >= (int)sizeof(InterestRequest)) {
+                InterestRequest update;
+                std::memcpy(&update, request, sizeof(update));
+                uint16_t senders[INTEREST_MAX_SENDERS];
+                size_t listed = (received - sizeof(InterestRequest)) / sizeof(uint16_t);
+                if (update.kind > INTEREST_AREA || (update.kind == INTEREST_SENDERS && update.count > listed)) continue;
+                std::memcpy(senders, request + sizeof(InterestRequest), listed * sizeof(uint16_t));
+                interest.update(from, update, senders);
+                continue;
+            }
+
+            TrailQuery query;
+            if (received != (int)sizeof(query) || magic != TRAIL_QUERY_MAGIC) continue;
+            std::memcpy(&query, request, sizeof(query));
+
+            TrailReplyHeader header;
+            header.magic = TRAIL_QUERY_MAGIC;
+            header.now = announcerClockNs();
+            int64_t since = query.window_ms ? header.now - (int64_t)query.window_ms * 1000000 : std::numeric_limits<int64_t>::min();
+            history.sendTrail(sock, query.node_id, since, header, from);
+        }
+
+        closesocket(sock);
+        std::cout << "Control server stopped.\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Control server error: " << e.what() << std::endl;
+    }
+}
+
+// Hierarchical cell index on the sphere, in the style of S2: the sphere is
+// projected onto the 6 faces of a cube and each face is split as a quadtree down
+// to level 30. A cell id is 64 bits: face in the top 3 bits, then two bits per
+// level in Z order, then a 1 bit that marks the level. All descendants of a cell
+// form one contiguous id range, so entities are kept in one array sorted by the
+// id of their leaf cell and a region query scans the ranges of a few cells that
+// cover the region.
+class SphereIndex {
+private:
+    struct Vec3 {
+        double x, y, z;
+    };
+
+    struct Entry {
+        uint64_t cell;
+        uint16_t id;
+        bool operator<(const Entry& other) const { return cell < other.cell; }
+    };
+
+    struct Bound {
+        uint64_t cell;
+        Vec3 center;
+        double radius;               // angle from center that holds the whole cell
+        double cos_radius, sin_radius;
+        bool inside;                 // cell lies entirely in the query region
+    };
+
+    static constexpr int MAX_LEVEL = 30;
+
+    std::vector<Entry> entries;      // sorted by cell
+    std::vector<Entry> moved, merged;
+    std::vector<uint64_t> node_cell; // leaf cell, indexed by node id
+    std::vector<Vec3> points;        // indexed by node id
+    std::vector<float> lats, lons;   // degrees, indexed by node id
+
+    static double dot(const Vec3& a, const Vec3& b) { return a.x*b.x + a.y*b.y + a.z*b.z; }
+
+    static Vec3 fromLatLon(double lat, double lon) {
+        return {std::cos(lat) * std::cos(lon), std::cos(lat) * std::sin(lon), std::sin(lat)};
+    }
+
+    // quadratic projection, keeps cell areas within a small factor of each other
+    static double stToUV(double s) {
+        return s >= 0.5 ? (4*s*s - 1) / 3 : (1 - 4*(1 - s)*(1 - s)) / 3;
+    }
+
+    static double uvToST(double u) {
+        return u >= 0 ? 0.5 * std::sqrt(1 + 3*u) : 1 - 0.5 * std::sqrt(1 - 3*u);
+    }
+
+    static Vec3 faceUVToXYZ(int face, double u, double v) {
+        switch (face) {
+            case 0: return {1, u, v};
+            case 1: return {-u, 1, v};
+            case 2: return {-u, -v, 1};
+            case 3: return {-1, -v, -u};
+            case 4: return {v, -1, -u};
+            default: return {v, u, -1};
+        }
+    }
+
+    static int xyzToFaceUV(const Vec3& p, double& u, double& v) {
+        double ax = std::fabs(p.x), ay = std::fabs(p.y), az = std::fabs(p.z);
+        int face = ax >= ay && ax >= az ? 0 : ay >= az ? 1 : 2;
+        if ((face == 0 ? p.x : face == 1 ? p.y : p.z) < 0) face += 3;
+        switch (face) {
+            case 0: u = p.y / p.x; v = p.z / p.x; break;
+            case 1: u = -p.x / p.y; v = p.z / p.y; break;
+            case 2: u = -p.x / p.z; v = -p.y / p.z; break;
+            case 3: u = p.z / p.x; v = p.y / p.x; break;
+            case 4: u = p.z / p.y; v = -p.x / p.y; break;
+            default: u = -p.y / p.z; v = -p.x / p.z; break;
+        }
+        return face;
+    }
+
+    static uint64_t spread(uint32_t v) {
+        uint64_t x = v;
+        x = (x | x << 16) & 0x0000FFFF0000FFFFull;
+        x = (x | x << 8) & 0x00FF00FF00FF00FFull;
+        x = (x | x << 4) & 0x0F0F0F0F0F0F0F0Full;
+        x = (x | x << 2) & 0x3333333333333333ull;
+        x = (x | x << 1) & 0x5555555555555555ull;
+        return x;
+    }
+
+    static uint32_t compact(uint64_t x) {
+        x &= 0x5555555555555555ull;
+        x = (x | x >> 1) & 0x3333333333333333ull;
+        x = (x | x >> 2) & 0x0F0F0F0F0F0F0F0Full;
+        x = (x | x >> 4) & 0x00FF00FF00FF00FFull;
+        x = (x | x >> 8) & 0x0000FFFF0000FFFFull;
+        x = (x | x >> 16) & 0x00000000FFFFFFFFull;
+        return (uint32_t)x;
+    }
+
+    static uint64_t leafCell(const Vec3& p) {
+        double u, v;
+        int face = xyzToFaceUV(p, u, v);
+        const double scale = (double)(1u << MAX_LEVEL);
+        uint32_t i = (uint32_t)std::max(0.0, std::min(scale - 1, std::floor(uvToST(u) * scale)));
+        uint32_t j = (uint32_t)std::max(0.0, std::min(scale - 1, std::floor(uvToST(v) * scale)));
+        return (uint64_t)face << 61 | (spread(i) << 1 | spread(j)) << 1 | 1;
+    }
+
+    static uint64_t lowestBit(uint64_t cell) { return cell & (~cell + 1); }
+
+    static Vec3 normalized(const Vec3& p) {
+        double norm = std::sqrt(dot(p, p));
+        return {p.x / norm, p.y / norm, p.z / norm};
+    }
+
+    // Cells are bounded by great circle arcs, so the corner farthest from the
+    // center bounds the whole cell.
+    static Bound bound(uint64_t cell) {
+        int face = cell >> 61;
+        uint64_t size = (uint64_t)1 << (__builtin_ctzll(cell) / 2);
+        uint64_t bits = (cell >> 1) & ((1ull << 60) - 1);
+        uint64_t i = compact(bits >> 1) & ~(size - 1), j = compact(bits) & ~(size - 1);
+        const double scale = (double)(1u << MAX_LEVEL);
+        double u[3], v[3];
+        for (int k = 0; k < 3; ++k) {
+            u[k] = stToUV((i + k * 0.5 * size) / scale);
+            v[k] = stToUV((j + k * 0.5 * size) / scale);
+        }
+        Bound b;
+        b.cell = cell;
+        b.center = normalized(faceUVToXYZ(face, u[1], v[1]));
+        b.cos_radius = 1.0;
+        for (int ku : {0, 2}) {
+            for (int kv : {0, 2}) b.cos_radius = std::min(b.cos_radius, dot(b.center, normalized(faceUVToXYZ(face, u[ku], v[kv]))));
+        }
+        b.cos_radius = std::max(-1.0, b.cos_radius - 1e-12);
+        b.sin_radius = std::sqrt(1 - b.cos_radius * b.cos_radius);
+        b.radius = std::acos(b.cos_radius);
+        b.inside = false;
+        return b;
+    }
+
+    // Covers a region with at most SPHERE_COVER_CELLS cells, refining the largest
+    // cell that is only partly inside first. classify(bound) says whether a
+    // cell's bounding cap may touch the region, and sets bound.inside when it is
+    // certainly within it.
+    template <typename Classify>
+    void cover(Classify classify, std::vector<Bound>& cells) const {
+        cells.clear();
+        for (uint64_t face = 0; face < 6; ++face) {
+            Bound b = bound(face << 61 | 1ull << 60);
+            if (classify(b)) cells.push_back(b);
+        }
+        Bound children[4];
+        while (true) {
+            int best = -1;
+            for (size_t c = 0; c < cells.size(); ++c) {
+                if (cells[c].inside || lowestBit(cells[c].cell) == 1) continue;
+                if (best < 0 || cells[c].radius > cells[best].radius) best = c;
+            }
+            if (best < 0) break;
+            uint64_t lsb = lowestBit(cells[best].cell), child_lsb = lsb >> 2;
+            int kept = 0;
+            for (uint64_t k = 0; k < 4; ++k) {
+                Bound b = bound(cells[best].cell - lsb + child_lsb * (2*k + 1));
+                if (classify(b)) children[kept++] = b;
+            }
+            if (cells.size() - 1 + kept > SPHERE_COVER_CELLS) break;
+            cells.erase(cells.begin() + best);
+            cells.insert(cells.end(), children, children + kept);
+        }
+    }
+
+    template <typename Accept>
+    void scan(const std::vector<Bound>& cells, Accept accept, std::vector<uint16_t>& out) const {
+        for (const Bound& b : cells) {
+            uint64_t lsb = lowestBit(b.cell);
+            auto it = std::lower_bound(entries.begin(), entries.end(), Entry{b.cell - lsb + 1, 0});
+            for (; it != entries.end() && it->cell <= b.cell + lsb - 1; ++it) {
+                if (b.inside || accept(it->id)) out.push_back(it->id);
+            }
+        }
+    }
+
+public:
+    // Reindexes from positions indexed by node id. Only nodes whose leaf cell
+    // changed are re-sorted; they are merged back into the rest, which stays sorted.
+    void update(const std::vector<std::pair<float, float>>& positions) {
+        size_t n = positions.size() > 1 ? positions.size() - 1 : 0;
+        bool rebuild = node_cell.size() != n + 1;
+        if (rebuild) {
+            node_cell.assign(n + 1, 0);
+            points.resize(n + 1);
+            lats.resize(n + 1);
+            lons.resize(n + 1);
+            entries.clear();
+        }
+        moved.clear();
+        for (size_t i = 1; i <= n; ++i) {
+            float lon = positions[i].first / WORLD_SIZE * 360.0f - 180.0f;
+            float lat = positions[i].second / WORLD_SIZE * 180.0f - 90.0f;
+            if (!rebuild && lat == lats[i] && lon == lons[i]) continue;
+            lats[i] = lat;
+            lons[i] = lon;
+            points[i] = fromLatLon(lat * M_PI / 180, lon * M_PI / 180);
+            uint64_t cell = leafCell(points[i]);
+            if (cell == node_cell[i]) continue;
+            node_cell[i] = cell;
+            moved.push_back({cell, (uint16_t)i});
+        }
+        if (moved.empty()) return;
+
+        std::sort(moved.begin(), moved.end());
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const Entry& e) {
+            return e.cell != node_cell[e.id];
+        }), entries.end());
+        merged.resize(entries.size() + moved.size());
+        std::merge(entries.begin(), entries.end(), moved.begin(), moved.end(), merged.begin());
+        entries.swap(merged);
+    }
+
+    float lat(uint16_t id) const { return lats[id]; }
+    float lon(uint16_t id) const { return lons[id]; }
+
+    void cap(double lat, double lon, double radius, std::vector<uint16_t>& out) const {
+        out.clear();
+        Vec3 center = fromLatLon(lat * M_PI / 180, lon * M_PI / 180);
+        double r = std::min(radius, 180.0) * M_PI / 180, cos_r = std::cos(r), sin_r = std::sin(r);
+        std::vector<Bound> cells;
+        // angle sums compared through their cosines, to stay clear of acos per cell
+        cover([&](Bound& b) {
+            double d = dot(center, b.center);
+            b.inside = b.radius <= r && d >= cos_r * b.cos_radius + sin_r * b.sin_radius;
+            return r + b.radius >= M_PI || d >= cos_r * b.cos_radius - sin_r * b.sin_radius;
+        }, cells);
+        scan(cells, [&](uint16_t id) { return dot(center, points[id]) >= cos_r; }, out);
+    }
+
+    void rect(double lat_lo, double lon_lo, double lat_hi, double lon_hi, std::vector<uint16_t>& out) const {
+        out.clear();
+        if (lat_lo > lat_hi) return;
+        const double rad = M_PI / 180;
+        bool full = lon_hi - lon_lo >= 360.0;
+        auto wrap = [](double lon) {
+            lon = std::fmod(lon + 180.0, 360.0);
+            return (lon < 0 ? lon + 360.0 : lon) - 180.0;
+        };
+        lon_lo = wrap(lon_lo);
+        lon_hi = wrap(lon_hi);
+        auto contains = [&](double lat, double lon) {
+            if (lat < lat_lo || lat > lat_hi) return false;
+            if (full) return true;
+            return lon_lo <= lon_hi ? lon >= lon_lo && lon <= lon_hi : lon >= lon_lo || lon <= lon_hi;
+        };
+        // never more than the distance to the rectangle's boundary: the distance
+        // to the parallels through its latitude bounds and to the great circles
+        // through its meridians
+        auto edge_distance = [&](const Vec3& p) {
+            double lat = std::asin(std::max(-1.0, std::min(1.0, p.z)));
+            double d = std::min(std::fabs(lat - lat_lo * rad), std::fabs(lat - lat_hi * rad));
+            if (!full) {
+                for (double lon : {lon_lo * rad, lon_hi * rad}) {
+                    d = std::min(d, std::asin(std::min(1.0, std::fabs(-std::sin(lon) * p.x + std::cos(lon) * p.y))));
+                }
+            }
+            return d;
+        };
+        std::vector<Bound> cells;
+        cover([&](Bound& b) {
+            const Vec3& p = b.center;
+            bool center_in = contains(std::asin(std::max(-1.0, std::min(1.0, p.z))) / rad, std::atan2(p.y, p.x) / rad);
+            double d = edge_distance(p);
+            b.inside = center_in && d >= b.radius;
+            return center_in || d <= b.radius;
+        }, cells);
+        scan(cells, [&](uint16_t id) { return contains(lats[id], lons[id]); }, out);
+    }
+};
+
+// Reply datagrams staged for one batch of spatial queries and sent together.
+class ReplyBatch {
+private:
+    struct Reply {
+        sockaddr_in to;
+        size_t size;
+        char data[REPLY_MTU];
+    };
+    std::vector<Reply> replies;
+    size_t count = 0;
+
+public:
+    ReplyBatch() : replies(QUERY_BATCH) {}
+
+    char* add(const sockaddr_in& to, size_t size) {
+        if (count == replies.size()) replies.resize(replies.size() * 2);
+        Reply& reply = replies[count++];
+        reply.to = to;
+        reply.size = size;
+        return reply.data;
+    }
+
+    void send(SOCKET sock) {
+#ifdef __linux__
+        std::vector<mmsghdr> msgs(count);
+        std::vector<iovec> iovs(count);
+        for (size_t i = 0; i < count; ++i) {
+            iovs[i] = {replies[i].data, replies[i].size};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_name = &replies[i].to;
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        for (size_t sent = 0; sent < count;) {
+            int done = sendmmsg(sock, msgs.data() + sent, count - sent, 0);
+            sent += done > 0 ? done : 1; // skip a reply the kernel refuses
+        }
+#else
+        for (size_t i = 0; i < count; ++i) {
+            sendto(sock, replies[i].data, (int)replies[i].size, 0, (sockaddr*)&replies[i].to, sizeof(sockaddr_in));
+        }
+#endif
+        count = 0;
+    }
+};
+
+// Answers range, nearest and box queries against a grid index of the live
+// positions, cap and rect queries against a sphere index of the same
+// positions, and inbound queries against the topology's reverse edge index.
+// Queries are taken in batches of up to QUERY_BATCH per system call and the
+// indexes are updated at most once per batch, when positions changed.
+void spatialServer() {
+    try {
+        SOCKET sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sock == INVALID_SOCKET) throw std::runtime_error("Failed to create socket");
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(SPATIAL_QUERY_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            closesocket(sock);
+            throw std::runtime_error("Failed to bind spatial query port");
+        }
+
+#ifdef _WIN32
+        DWORD timeout = 200;
+#else
+        timeval timeout{0, 200000};
+#endif
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+
+        std::cout << "Spatial query server started on port " << SPATIAL_QUERY_PORT << "\n";
+
+        SpatialIndex index;
+        SphereIndex sphere;
+        uint64_t version = 0;
+        std::vector<std::pair<float, float>> positions;
+        std::vector<uint32_t> results;
+        std::vector<uint16_t> sphere_results;
+        std::vector<InboundEdge> inbound;
+        ReplyBatch replies;
+        SpatialQuery queries[QUERY_BATCH];
+        sockaddr_in from[QUERY_BATCH];
+        int sizes[QUERY_BATCH];
+
+        while (running) {
+            int received = 0;
+#ifdef __linux__
+            mmsghdr msgs[QUERY_BATCH];
+            iovec iovs[QUERY_BATCH];
+            for (int i = 0; i < QUERY_BATCH; ++i) {
+                iovs[i] = {&queries[i], sizeof(SpatialQuery)};
+                msgs[i] = {};
+                msgs[i].msg_hdr.msg_name = &from[i];
+                msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            received = recvmmsg(sock, msgs, QUERY_BATCH, MSG_WAITFORONE, nullptr);
+            for (int i = 0; i < received; ++i) sizes[i] = msgs[i].msg_len;
+#else
+            socklen_t from_len = sizeof(from[0]);
+            sizes[0] = recvfrom(sock, (char*)&queries[0], sizeof(SpatialQuery), 0, (sockaddr*)&from[0], &from_len);
+            received = sizes[0] >= 0 ? 1 : 0;
+#endif
+            if (received <= 0) continue;
+            if (topology.positionsSince(version, positions)) {
+                index.build(positions);
+                sphere.update(positions);
+            }
+
+            for (int i = 0; i < received; ++i) {
+                const SpatialQuery& query = queries[i];
+                if (sizes[i] != (int)sizeof(SpatialQuery) || query.magic != SPATIAL_QUERY_MAGIC) continue;
+                if (query.kind == QUERY_INBOUND) {
+                    // answered from the reverse edge index, chunked like the others
+                    topology.inboundEdges(query.k, inbound);
+                    SpatialReplyHeader header;
+                    header.magic = SPATIAL_QUERY_MAGIC;
+                    header.request_id = query.request_id;
+                    header.total = inbound.size();
+                    header.chunks = std::max<size_t>(1, (inbound.size() + INBOUND_PER_CHUNK - 1) / INBOUND_PER_CHUNK);
+                    for (header.chunk = 0; header.chunk < header.chunks; ++header.chunk) {
+                        size_t first = header.chunk * INBOUND_PER_CHUNK;
+                        header.count = std::min(INBOUND_PER_CHUNK, inbound.size() - first);
+                        char* out = replies.add(from[i], sizeof(header) + header.count * sizeof(InboundEdge));
+                        std::memcpy(out, &header, sizeof(header));
+                        std::memcpy(out + sizeof(header), inbound.data() + first, header.count * sizeof(InboundEdge));
+                    }
+                    continue;
+                }
+                bool on_sphere = query.kind == QUERY_CAP || query.kind == QUERY_RECT;
+                if (query.kind == QUERY_RANGE) index.range(query.x, query.y, query.a, results);
+                else if (query.kind == QUERY_NEAREST) index.nearest(query.x, query.y, query.k, results);
+                else if (query.kind == QUERY_BOX) index.box(query.x, query.y, query.a, query.b, results);
+                else if (query.kind == QUERY_CAP) sphere.cap(query.x, query.y, query.a, sphere_results);
+                else if (query.kind == QUERY_RECT) sphere.rect(query.x, query.y, query.a, query.b, sphere_results);
+                else continue;
+
+                size_t total = on_sphere ? sphere_results.size() : results.size();
+                SpatialReplyHeader header;
+                header.magic = SPATIAL_QUERY_MAGIC;
+                header.request_id = query.request_id;
+                header.total = total;
+                header.chunks = std::max<size_t>(1, (total + RESULTS_PER_CHUNK - 1) / RESULTS_PER_CHUNK);
+                for (header.chunk = 0; header.chunk < header.chunks; ++header.chunk) {
+                    size_t first = header.chunk * RESULTS_PER_CHUNK;
+                    header.count = std::min(RESULTS_PER_CHUNK, total - first);
+                    char* out = replies.add(from[i], sizeof(header) + header.count * SPATIAL_RESULT_SIZE);
+                    std::memcpy(out, &header, sizeof(header));
+                    out += sizeof(header);
+                    for (size_t r = first; r < first + header.count; ++r) {
+                        if (on_sphere) {
+                            uint16_t id = sphere_results[r];
+                            out += packPosition(id, {sphere.lat(id), sphere.lon(id)}, out);
+                        } else {
+                            uint32_t e = results[r];
+                            out += packPosition(index.id(e), {index.x(e), index.y(e)}, out);
+                        }
+                    }
+                }
+            }
+            replies.send(sock);
+        }
+
+        closesocket(sock);
+        std::cout << "Spatial query server stopped.\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Spatial query server error: " << e.what() << std::endl;
+    }
+}
+
+void checkpointServer(double interval_s) {
+    try {
+        auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval_s));
+        auto next = std::chrono::steady_clock::now() + interval;
+        std::cout << "Checkpoints every " << interval_s << " s\n";
+
+        while (running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            if (std::chrono::steady_clock::now() < next) continue;
+            checkpointer.snapshot();
+            next = std::chrono::steady_clock::now() + interval;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Checkpoint error: " << e.what() << std::endl;
+    }
+}
+
+// Parses and validates the file on this thread and publishes the new version
+// for the servers; a rejected file leaves the running config untouched.
+void reloadConfig(const std::string& path) {
+    try {
+        std::atomic_store(&runtime_config, loadRuntimeConfig(path));
+        std::cout << "Configuration reloaded from " << path << "\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Configuration rejected, keeping the previous one: " << e.what() << std::endl;
+    }
+}
+
+// Watches the config file and reloads it after every completed write. Editors
+// that save through a temporary file and rename are covered by watching the
+// directory rather than the file itself.
+void configServer(const std::string& path) {
+    try {
+#ifdef __linux__
+        size_t slash = path.rfind('/');
+        std::string dir = slash == std::string::npos ? "." : path.substr(0, std::max<size_t>(slash, 1));
+        std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) throw std::runtime_error("inotify_init1 failed");
+        if (inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            close(fd);
+            throw std::runtime_error("Cannot watch " + dir);
+        }
+        std::cout << "Watching " << path << " for configuration changes\n";
+
+        alignas(inotify_event) char events[4096];
+        while (running) {
+            pollfd watch{fd, POLLIN, 0};
+            if (poll(&watch, 1, 200) <= 0) continue;
+            bool changed = false;
+            ssize_t length;
+            while ((length = read(fd, events, sizeof(events))) > 0) {
+                for (char* at = events; at < events + length;) {
+                    const inotify_event* event = (const inotify_event*)at;
+                    changed |= event->len && name == event->name;
+                    at += sizeof(inotify_event) + event->len;
+                }
+            }
+            if (changed) reloadConfig(path);
+        }
+        close(fd);
+#else
+        // no inotify: compare the modification time a few times a second
+        struct stat info;
+        time_t modified = stat(path.c_str(), &info) == 0 ? info.st_mtime : 0;
+        std::cout << "Polling " << path << " for configuration changes\n";
+        while (running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            if (stat(path.c_str(), &info) != 0 || info.st_mtime == modified) continue;
+            modified = info.st_mtime;
+            reloadConfig(path);
+        }
+#endif
+    } catch (const std::exception& e) {
+        std::cerr << "Config server error: " << e.what() << std::endl;
+    }
+}
+
+void routingServer(uint64_t queries) {
+    try {
+        RoutingSimulator simulator;
+        std::vector<std::pair<float, float>> positions;
+        std::vector<GraphPacket> graphs;
+        std::mt19937 gen(std::random_device{}());
+        unsigned num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        std::cout << "Routing simulator started, " << queries << " queries per tick on " << num_threads << " threads\n";
+
+        while (running) {
+            auto start = std::chrono::steady_clock::now();
+            if (watchdog.shedding(ShedLevel::SkipExtras)) {
+                watchdog.skippedExtras();
+                std::this_thread::sleep_until(start + std::chrono::milliseconds(ROUTING_TICK_MS));
+                continue;
+            }
+            topology.snapshot(positions, graphs);
+            simulator.build(positions, graphs);
+            RoutingReport report = simulator.run(queries, num_threads, gen);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+
+            std::vector<uint16_t> worst;
+            for (size_t i = 1; i < report.drops.size(); ++i) {
+                if (report.drops[i]) worst.push_back(i);
+            }
+            std::sort(worst.begin(), worst.end(), [&](uint16_t a, uint16_t b) { return report.drops[a] > report.drops[b]; });
+            if (worst.size() > 5) worst.resize(5);
+
+            std::cout << "Routing: " << report.delivered << "/" << report.queries << " delivered ("
+                      << 100.0 * report.delivered / std::max<uint64_t>(1, report.queries) << "%, "
+                      << 100.0 * report.reachable / std::max<uint64_t>(1, report.queries) << "% reachable), stretch "
+                      << report.stretch_sum / std::max<uint64_t>(1, report.delivered) << ", "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms";
+            if (!worst.empty()) {
+                std::cout << ", drops at";
+                for (uint16_t node_id : worst) std::cout << " " << node_id << ":" << report.drops[node_id];
+            }
+            std::cout << "\n";
+
+            std::this_thread::sleep_until(start + std::chrono::milliseconds(ROUTING_TICK_MS));
+        }
+
+        std::cout << "Routing simulator stopped.\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Routing simulator error: " << e.what() << std::endl;
+    }
+}
+
+struct SweepConfig {
+    int num_nodes;
+    int rate;      // position ticks per virtual second
+    int min_edges;
+    int max_edges;
+    std::string transport; // udp, endpoints or null
+};
+
+struct SweepResult {
+    int status = -1; // 0 on success
+    double virtual_s = 0;
+    double wall_s = 0;
+    uint64_t datagrams = 0;
+    uint64_t bytes = 0;
+    uint64_t send_errors = 0;
+    double tick_p50_us = 0;
+    double tick_p99_us = 0;
+    double tick_max_us = 0;
+    double user_cpu_s = 0;
+    double sys_cpu_s = 0;
+    long max_rss_kb = 0;
+};
+
+// Runs one configuration flat out in virtual time: every tick moves the nodes,
+// sends all positions and a 1/rate share of the graph round, without sleeping.
+SweepResult runSweepConfig(const SweepConfig& config, double duration_s, int run_index) {
+    SweepResult result;
+    NodeManager nodeManager(config.num_nodes);
+    GraphGenerator graphGen(config.num_nodes, config.min_edges, config.max_edges);
+    int position_port = SWEEP_BASE_PORT + 2 * run_index;
+
+    std::unique_ptr<Transport> position_transport, graph_transport;
+    std::unique_ptr<EndpointPool> endpoints;
+    if (config.transport == "udp") {
+        position_transport.reset(new UDPServer(position_port));
+        graph_transport.reset(new UDPServer(position_port + 1));
+    } else if (config.transport == "endpoints") {
+        endpoints.reset(new EndpointPool(config.num_nodes, EndpointMode::Address, ENDPOINT_BASE_PORT + run_index));
+        position_transport.reset(new EndpointTransport(endpoints.get(), position_port));
+        graph_transport.reset(new EndpointTransport(endpoints.get(), position_port + 1));
+    } else if (config.transport == "null") {
+        position_transport.reset(new NullTransport());
+        graph_transport.reset(new NullTransport());
+    } else {
+        throw std::runtime_error("unknown transport " + config.transport);
+    }
+
+    int ticks = std::max(1, (int)(duration_s * config.rate));
+    int graphs_per_tick = (config.num_nodes + config.rate - 1) / config.rate;
+    uint16_t next_sender = 1;
+    std::vector<EndpointDatagram> batch(std::max(config.num_nodes, graphs_per_tick));
+    std::vector<float> tick_us(ticks);
+    std::vector<GraphPacket> packets(graphs_per_tick);
+
+    auto send = [&](Transport& transport, size_t n) {
+        result.datagrams += n;
+        for (size_t i = 0; i < n; ++i) result.bytes += batch[i].size;
+        transport.sendBatch(batch.data(), n);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < ticks; ++tick) {
+        auto tick_start = std::chrono::steady_clock::now();
+
+        nodeManager.updatePositions();
+        size_t n = 0;
+        for (uint16_t node_id : nodeManager.getNodeIds()) {
+            batch[n].node_id = node_id;
+            batch[n].size = packPosition(node_id, nodeManager.getPosition(node_id), batch[n].data);
+            n++;
+        }
+        send(*position_transport, n);
+
+        graphGen.generateGraphs(next_sender, graphs_per_tick, packets.data());
+        for (n = 0; n < (size_t)graphs_per_tick; ++n) {
+            batch[n].node_id = packets[n].sender_id;
+            batch[n].size = graphPacketSize(packets[n]);
+            std::memcpy(batch[n].data, &packets[n], batch[n].size);
+        }
+        next_sender = (next_sender - 1 + graphs_per_tick) % config.num_nodes + 1;
+        send(*graph_transport, n);
+
+        tick_us[tick] = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - tick_start).count();
+    }
+    result.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.virtual_s = (double)ticks / config.rate;
+    position_transport->flush();
+    graph_transport->flush();
+    result.send_errors = endpoints ? endpoints->droppedCount() : position_transport->droppedCount() + graph_transport->droppedCount();
+
+    std::sort(tick_us.begin(), tick_us.end());
+    result.tick_p50_us = tick_us[ticks / 2];
+    result.tick_p99_us = tick_us[std::min(ticks - 1, ticks * 99 / 100)];
+    result.tick_max_us = tick_us.back();
+    result.status = 0;
+    return result;
+}
+
+// Parses "nodes=20,2000;rate=10,50;edges=6-35,20-50;transport=udp,null" into the
+// cartesian product of all listed values.
+std::vector<SweepConfig> parseSweepGrid(const std::string& spec) {
+    std::vector<int> nodes{NUM_NODES}, rates{10};
+    std::vector<std::pair<int, int>> edges{{MIN_EDGES, MAX_EDGES}};
+    std::vector<std::string> transports{"udp"};
+
+    std::stringstream dims(spec);
+    std::string dim;
+    while (std::getline(dims, dim, ';')) {
+        size_t eq = dim.find('=');
+        if (eq == std::string::npos) throw std::runtime_error("expected key=values in '" + dim + "'");
+        std::string key = dim.substr(0, eq);
+        std::vector<std::string> values;
+        std::stringstream list(dim.substr(eq + 1));
+        std::string value;
+        while (std::getline(list, value, ',')) values.push_back(value);
+        if (values.empty()) throw std::runtime_error("no values for " + key);
+
+        if (key == "nodes") {
+            nodes.clear();
+            for (auto& v : values) nodes.push_back(std::stoi(v));
+        } else if (key == "rate") {
+            rates.clear();
+            for (auto& v : values) rates.push_back(std::stoi(v));
+        } else if (key == "edges") {
+            edges.clear();
+            for (auto& v : values) {
+                size_t dash = v.find('-');
+                int lo = std::stoi(v.substr(0, dash));
+                int hi = dash == std::string::npos ? lo : std::stoi(v.substr(dash + 1));
+                edges.push_back({lo, hi});
+            }
+        } else if (key == "transport") {
+            transports = values;
+        } else {
+            throw std::runtime_error("unknown sweep parameter " + key);
+        }
+    }
+
+    std::vector<SweepConfig> grid;
+    for (int n : nodes)
+        for (int r : rates)
+            for (auto& e : edges)
+                for (auto& t : transports) {
+                    if (n < 2 || n > 65535 || r < 1 || e.first < 0 || e.first > e.second || e.second > 50) {
+                        throw std::runtime_error("invalid sweep point nodes=" + std::to_string(n) + " rate=" + std::to_string(r) +
+                                                 " edges=" + std::to_string(e.first) + "-" + std::to_string(e.second));
+                    }
+                    grid.push_back({n, r, e.first, e.second, t});
+                }
+    return grid;
+}
+
+// Runs every grid point in its own process pinned to its own set of cores and
+// writes one CSV row per configuration.
+int runSweep(const std::string& spec, const std::string& out_path, double duration_s, int cores_per_run) {
+    std::vector<SweepConfig> grid;
+    try {
+        grid = parseSweepGrid(spec);
+    } catch (const std::exception& e) {
+        std::cerr << "Sweep error: " << e.what() << std::endl;
+        return 1;
+    }
+    std::vector<SweepResult> results(grid.size());
+
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    cores_per_run = std::max(1, std::min(cores_per_run, cores));
+    int slots = cores / cores_per_run;
+    std::cout << "Sweep: " << grid.size() << " configurations, " << slots << " at a time on " << cores_per_run << " core(s) each\n";
+
+#ifdef _WIN32
+    // no fork: run in-process, one after another
+    for (size_t i = 0; i < grid.size(); ++i) {
+        try {
+            results[i] = runSweepConfig(grid[i], duration_s, i);
+        } catch (const std::exception& e) {
+            std::cerr << "Sweep run " << i << " failed: " << e.what() << std::endl;
+        }
+    }
+#else
+    struct Running { pid_t pid; size_t index; int slot; int fd; };
+    std::vector<Running> running_runs;
+    std::vector<bool> slot_busy(slots, false);
+    size_t next = 0;
+
+    while (next < grid.size() || !running_runs.empty()) {
+        while (next < grid.size() && (int)running_runs.size() < slots) {
+            int slot = std::find(slot_busy.begin(), slot_busy.end(), false) - slot_busy.begin();
+            int fds[2];
+            if (pipe(fds) != 0) {
+                std::cerr << "Sweep: pipe failed\n";
+                return 1;
+            }
+            std::cout.flush();
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+#ifdef __linux__
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (int c = slot * cores_per_run; c < (slot + 1) * cores_per_run; ++c) CPU_SET(c, &set);
+                sched_setaffinity(0, sizeof(set), &set);
+#endif
+                SweepResult result;
+                try {
+                    result = runSweepConfig(grid[next], duration_s, next);
+                } catch (const std::exception& e) {
+                    std::cerr << "Sweep run " << next << " failed: " << e.what() << std::endl;
+                }
+                ssize_t written = write(fds[1], &result, sizeof(result));
+                _exit(written == (ssize_t)sizeof(result) ? 0 : 1);
+            }
+            close(fds[1]);
+            if (pid < 0) {
+                close(fds[0]);
+                std::cerr << "Sweep: fork failed\n";
+                return 1;
+            }
+            slot_busy[slot] = true;
+            running_runs.push_back({pid, next, slot, fds[0]});
+            next++;
+        }
+
+        int status;
+        rusage usage;
+        pid_t pid = wait4(-1, &status, 0, &usage);
+        if (pid < 0) break;
+        auto it = std::find_if(running_runs.begin(), running_runs.end(), [&](const Running& r) { return r.pid == pid; });
+        if (it == running_runs.end()) continue;
+
+        SweepResult& result = results[it->index];
+        if (read(it->fd, &result, sizeof(result)) != (ssize_t)sizeof(result)) result.status = -1;
+        close(it->fd);
+        result.user_cpu_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+        result.sys_cpu_s = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+        result.max_rss_kb = usage.ru_maxrss;
+        std::cout << "Sweep: finished " << it->index + 1 << "/" << grid.size() << "\n";
+        slot_busy[it->slot] = false;
+        running_runs.erase(it);
+    }
+#endif
+
+    std::ofstream out(out_path);
+    if (!out) {
+        std::cerr << "Sweep: cannot write " << out_path << "\n";
+        return 1;
+    }
+    out << "nodes,rate,min_edges,max_edges,transport,status,virtual_s,wall_s,speedup,datagrams,bytes,"
+           "datagrams_per_s,mbytes_per_s,send_errors,tick_p50_us,tick_p99_us,tick_max_us,user_cpu_s,sys_cpu_s,max_rss_kb\n";
+    for (size_t i = 0; i < grid.size(); ++i) {
+        const SweepConfig& c = grid[i];
+        const SweepResult& r = results[i];
+        double wall = r.wall_s > 0 ? r.wall_s : 1;
+        out << c.num_nodes << "," << c.rate << "," << c.min_edges << "," << c.max_edges << "," << c.transport << ","
+            << r.status << "," << r.virtual_s << "," << r.wall_s << "," << r.virtual_s / wall << ","
+            << r.datagrams << "," << r.bytes << "," << r.datagrams / wall << "," << r.bytes / wall / 1e6 << ","
+            << r.send_errors << "," << r.tick_p50_us << "," << r.tick_p99_us << "," << r.tick_max_us << ","
+            << r.user_cpu_s << "," << r.sys_cpu_s << "," << r.max_rss_kb << "\n";
+    }
+    std::cout << "Sweep results written to " << out_path << "\n";
+    return 0;
+}
+
+// One independent world hosted beside others (--scenario): its own nodes, graph
+// state and pair of streams.
+struct ScenarioConfig {
+    std::string name;
+    int num_nodes = NUM_NODES;
+    int port = 0;           // positions; graphs go to port + 1
+    int rate = 10;          // position rounds per second
+    int graph_every = 20;   // position rounds per graph round
+    int min_edges = MIN_EDGES;
+    int max_edges = MAX_EDGES;
+    GraphModel graph_model = GraphModel::Random;
+    uint64_t fixed_seed = 0; // non-zero: deterministic fixed-point positions
+    int weight = 1;         // share of contended worker time
+    int quota_ms = 0;       // worker milliseconds per second, 0 for no limit
+};
+
+// Parses "name=teamA;nodes=50;port=14000;rate=10;graph_every=20;edges=6-35;
+// model=evolving;seed=7;weight=2;quota=50"; unset keys keep their defaults.
+ScenarioConfig parseScenario(const std::string& spec, int index) {
+    ScenarioConfig config;
+    config.name = "scenario" + std::to_string(index + 1);
+    config.port = SCENARIO_BASE_PORT + 2 * index;
+
+    std::stringstream fields(spec);
+    std::string field;
+    while (std::getline(fields, field, ';')) {
+        size_t eq = field.find('=');
+        if (eq == std::string::npos) throw std::runtime_error("expected key=value in '" + field + "'");
+        std::string key = field.substr(0, eq), value = field.substr(eq + 1);
+        if (key == "name") config.name = value;
+        else if (key == "nodes") config.num_nodes = std::stoi(value);
+        else if (key == "port") config.port = std::stoi(value);
+        else if (key == "rate") config.rate = std::stoi(value);
+        else if (key == "graph_every") config.graph_every = std::stoi(value);
+        else if (key == "edges") {
+            size_t dash = value.find('-');
+            config.min_edges = std::stoi(value.substr(0, dash));
+            config.max_edges = dash == std::string::npos ? config.min_edges : std::stoi(value.substr(dash + 1));
+        } else if (key == "model") {
+            if (value == "random") config.graph_model = GraphModel::Random;
+            else if (value == "evolving") config.graph_model = GraphModel::Evolving;
+            else throw std::runtime_error("model takes 'random' or 'evolving'");
+        } else if (key == "seed") config.fixed_seed = std::stoull(value);
+        else if (key == "weight") config.weight = std::stoi(value);
+        else if (key == "quota") config.quota_ms = std::stoi(value);
+        else throw std::runtime_error("unknown scenario parameter " + key);
+    }
+    if (config.num_nodes < 2 || config.num_nodes > 65535 || config.port < 1 || config.port > 65534 || config.rate < 1 ||
+        config.rate > 1000 || config.graph_every < 1 || config.min_edges < 0 || config.min_edges > config.max_edges ||
+        config.max_edges > 50 || config.weight < 1 || config.quota_ms < 0 || config.quota_ms > 1000) {
+        throw std::runtime_error("invalid settings for scenario " + config.name);
+    }
+    return config;
+}
+
+class Scenario {
+public:
+    struct TickStats {
+        uint64_t datagrams = 0;
+        uint64_t send_errors = 0;
+    };
+
+    const ScenarioConfig config;
+    const std::chrono::steady_clock::duration period;
+
+    // Scheduling state and counters, guarded by the host's mutex.
+    std::chrono::steady_clock::time_point due;
+    std::chrono::steady_clock::time_point window_start; // current quota second
+    int64_t window_used_ns = 0;
+    uint64_t vruntime_ns = 0; // worker time divided by weight
+    bool busy = false;        // a worker is running its tick
+    bool idle = false;        // was waiting for its period or quota at the last pick
+    uint64_t ticks = 0, late = 0, skipped = 0, throttled = 0;
+    uint64_t datagrams = 0, send_errors = 0;
+    int64_t busy_ns = 0;
+
+    Scenario(const ScenarioConfig& scenario_config)
+        : config(scenario_config), period(std::chrono::nanoseconds(1000000000 / config.rate)),
+          nodes(config.num_nodes), graphs(config.num_nodes, config.min_edges, config.max_edges, config.graph_model),
+          position_server(config.port), graph_server(config.port + 1), packets(config.num_nodes) {
+        if (config.fixed_seed) nodes.useFixedPoint(config.fixed_seed);
+        // the host's pool is the only parallelism, so quotas and vruntime see all the work
+        nodes.setMaxThreads(1);
+        graphs.setMaxThreads(1);
+    }
+
+    // One position round, plus a graph round every graph_every ticks. Only
+    // ever run by one worker at a time, so the world needs no locking.
+    TickStats tick(uint64_t number) {
+        TickStats stats;
+        char datagram[MAX_DATAGRAM_SIZE];
+        nodes.updatePositions();
+        for (uint16_t node_id : nodes.getNodeIds()) {
+            size_t size = packPosition(node_id, nodes.getPosition(node_id), datagram);
+            if (!position_server.sendPacket(datagram, size)) stats.send_errors++;
+            stats.datagrams++;
+        }
+        position_server.flush();
+        if (number % config.graph_every == 0) {
+            graphs.advance();
+            graphs.generateGraphs(1, config.num_nodes, packets.data());
+            for (const GraphPacket& packet : packets) {
+                if (!graph_server.sendPacket(&packet, graphPacketSize(packet))) stats.send_errors++;
+                stats.datagrams++;
+            }
+            graph_server.flush();
+        }
+        return stats;
+    }
+
+private:
+    NodeManager nodes;
+    GraphGenerator graphs;
+    UDPServer position_server, graph_server;
+    std::vector<GraphPacket> packets;
+};
+
+// Runs every hosted scenario's ticks on one pool of workers. A free worker takes
+// the due scenario with the least weighted worker time (as in a fair-share CPU
+// scheduler), and a scenario that used up its quota for the current second
+// waits for the next one. A scenario more than a second behind skips ahead
+// rather than bursting to catch up.
+class ScenarioHost {
+private:
+    std::vector<std::unique_ptr<Scenario>> scenarios;
+    std::mutex mutex;
+    std::condition_variable wake;
+    uint64_t min_vruntime_ns = 0; // least vruntime among contending scenarios, never decreasing
+    std::vector<Scenario*> runnable;
+
+    // A scenario that was waiting (for its period or its quota) rejoins at no
+    // less than min_vruntime_ns, so time it spent idle is not owed back to it as
+    // a run of ticks ahead of everyone else.
+    Scenario* pick(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point& wake_at) {
+        Scenario* next = nullptr;
+        uint64_t floor = UINT64_MAX;
+        runnable.clear();
+        for (auto& scenario : scenarios) {
+            if (scenario->busy) {
+                floor = std::min(floor, scenario->vruntime_ns);
+                continue;
+            }
+            if (now - scenario->window_start >= std::chrono::seconds(1)) {
+                // a tick that overran the quota is paid back from the next second
+                scenario->window_start = now;
+                scenario->window_used_ns = std::max<int64_t>(0, scenario->window_used_ns - scenario->config.quota_ms * 1000000ll);
+            }
+            auto ready = scenario->due;
+            if (scenario->config.quota_ms && scenario->window_used_ns >= scenario->config.quota_ms * 1000000ll) {
+                ready = std::max(ready, scenario->window_start + std::chrono::seconds(1));
+            }
+            if (ready > now) {
+                scenario->idle = true;
+                wake_at = std::min(wake_at, ready);
+                continue;
+            }
+            if (!scenario->idle) floor = std::min(floor, scenario->vruntime_ns);
+            runnable.push_back(scenario.get());
+        }
+        if (floor != UINT64_MAX) min_vruntime_ns = std::max(min_vruntime_ns, floor);
+        for (Scenario* scenario : runnable) {
+            if (scenario->idle) {
+                scenario->vruntime_ns = std::max(scenario->vruntime_ns, min_vruntime_ns);
+                scenario->idle = false;
+            }
+            if (!next || scenario->vruntime_ns < next->vruntime_ns) next = scenario;
+        }
+        return next;
+    }
+
+    void worker() {
+        std::unique_lock<std::mutex> guard(mutex);
+        while (running) {
+            auto now = std::chrono::steady_clock::now();
+            auto wake_at = now + std::chrono::milliseconds(200); // notices shutdown
+            Scenario* scenario = pick(now, wake_at);
+            if (!scenario) {
+                wake.wait_until(guard, wake_at);
+                continue;
+            }
+            scenario->busy = true;
+            if (now - scenario->due > scenario->period) scenario->late++;
+            uint64_t number = scenario->ticks++;
+            guard.unlock();
+
+            Scenario::TickStats stats;
+            try {
+                stats = scenario->tick(number);
+            } catch (const std::exception& e) {
+                std::cerr << "Scenario " << scenario->config.name << " error: " << e.what() << std::endl;
+            }
+            auto end = std::chrono::steady_clock::now();
+            int64_t cost = std::chrono::duration_cast<std::chrono::nanoseconds>(end - now).count();
+
+            guard.lock();
+            scenario->busy = false;
+            scenario->datagrams += stats.datagrams;
+            scenario->send_errors += stats.send_errors;
+            scenario->busy_ns += cost;
+            scenario->vruntime_ns += cost / scenario->config.weight;
+            int64_t quota_ns = scenario->config.quota_ms * 1000000ll;
+            if (quota_ns && scenario->window_used_ns < quota_ns && scenario->window_used_ns + cost >= quota_ns) scenario->throttled++;
+            scenario->window_used_ns += cost;
+            scenario->due += scenario->period;
+            if (end - scenario->due > std::chrono::seconds(1)) {
+                uint64_t behind = (end - scenario->due) / scenario->period;
+                scenario->skipped += behind;
+                scenario->due += behind * scenario->period;
+            }
+            wake.notify_one();
+        }
+    }
+
+public:
+    void add(const ScenarioConfig& config) {
+        for (auto& scenario : scenarios) {
+            if (std::abs(scenario->config.port - config.port) < 2) {
+                throw std::runtime_error("scenarios " + scenario->config.name + " and " + config.name + " share a port");
+            }
+        }
+        scenarios.emplace_back(new Scenario(config));
+        scenarios.back()->due = scenarios.back()->window_start = std::chrono::steady_clock::now();
+    }
+
+    // Runs the workers until the global running flag clears, reporting every
+    // SCENARIO_REPORT_S seconds.
+    void run(int num_workers) {
+        std::vector<std::thread> workers;
+        for (int i = 0; i < num_workers; ++i) workers.emplace_back(&ScenarioHost::worker, this);
+        auto next_report = std::chrono::steady_clock::now() + std::chrono::seconds(SCENARIO_REPORT_S);
+        while (running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            if (std::chrono::steady_clock::now() < next_report) continue;
+            report();
+            next_report += std::chrono::seconds(SCENARIO_REPORT_S);
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+        report();
+    }
+
+    void report() {
+        std::lock_guard<std::mutex> guard(mutex);
+        int64_t total_ns = 0;
+        for (auto& scenario : scenarios) total_ns += scenario->busy_ns;
+        for (auto& scenario : scenarios) {
+            std::cout << "Scenario " << scenario->config.name << ": " << scenario->ticks << " ticks, " << scenario->late << " late, "
+                      << scenario->skipped << " skipped, quota hit " << scenario->throttled << " times, "
+                      << scenario->busy_ns / 1000000 << " ms worker time ("
+                      << (total_ns ? 100 * scenario->busy_ns / total_ns : 0) << "%), " << scenario->datagrams << " datagrams, "
+                      << scenario->send_errors << " send errors\n";
+        }
+    }
+};
+
+// Hosts every --scenario on a shared pool of num_workers threads until Enter.
+int runScenarios(const std::vector<std::string>& specs, int num_workers) {
+    ScenarioHost host;
+    try {
+        for (size_t i = 0; i < specs.size(); ++i) {
+            ScenarioConfig config = parseScenario(specs[i], i);
+            host.add(config);
+            std::cout << "Scenario " << config.name << ": " << config.num_nodes << " nodes on ports " << config.port << "/"
+                      << config.port + 1 << ", " << config.rate << " rounds/s, weight " << config.weight;
+            if (config.quota_ms) std::cout << ", quota " << config.quota_ms << " ms/s";
+            std::cout << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Scenario error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Hosting " << specs.size() << " scenarios on " << num_workers << " workers. Press Enter to stop...\n";
+    std::thread host_thread(&ScenarioHost::run, &host, num_workers);
+    std::thread clock_thread(clockServer);
+    std::cin.get();
+    running = false;
+    host_thread.join();
+    clock_thread.join();
+    std::cout << "Scenarios stopped. Exiting cleanly.\n";
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    std::string sweep_spec, sweep_out = "sweep.csv";
+    double sweep_duration = 10;
+    int sweep_cores = 1;
+    std::vector<std::string> scenario_specs;
+    int workers = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--routing") {
+            options.routing_queries = ROUTING_QUERIES;
+            if (i + 1 < argc && argv[i + 1][0] != '-') options.routing_queries = std::stoull(argv[++i]);
+        } else if (arg == "--nodes" && i + 1 < argc) {
+            options.num_nodes = std::stoi(argv[++i]);
+            if (options.num_nodes < 2 || options.num_nodes > 65535) {
+                std::cerr << "--nodes must be between 2 and 65535\n";
+                return 1;
+            }
+        } else if (arg == "--sweep" && i + 1 < argc) {
+            sweep_spec = argv[++i];
+        } else if (arg == "--sweep-out" && i + 1 < argc) {
+            sweep_out = argv[++i];
+        } else if (arg == "--sweep-duration" && i + 1 < argc) {
+            sweep_duration = std::stod(argv[++i]);
+        } else if (arg == "--sweep-cores" && i + 1 < argc) {
+            sweep_cores = std::stoi(argv[++i]);
+        } else if (arg == "--graph-model" && i + 1 < argc) {
+            std::string model = argv[++i];
+            if (model == "random") options.graph_model = GraphModel::Random;
+            else if (model == "evolving") options.graph_model = GraphModel::Evolving;
+            else {
+                std::cerr << "--graph-model takes 'random' or 'evolving'\n";
+                return 1;
+            }
+        } else if (arg == "--history" && i + 1 < argc) {
+            options.history_length = std::stoul(argv[++i]);
+            if (options.history_length > MAX_HISTORY_LENGTH) {
+                std::cerr << "--history must be at most " << MAX_HISTORY_LENGTH << "\n";
+                return 1;
+            }
+        } else if (arg == "--fixed-point") {
+            options.fixed_point = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') options.fixed_seed = std::stoull(argv[++i]);
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            options.checkpoint_path = argv[++i];
+        } else if (arg == "--checkpoint-interval" && i + 1 < argc) {
+            options.checkpoint_interval = std::stod(argv[++i]);
+        } else if (arg == "--restore" && i + 1 < argc) {
+            options.restore_path = argv[++i];
+        } else if (arg == "--scenario" && i + 1 < argc) {
+            scenario_specs.push_back(argv[++i]);
+        } else if (arg == "--workers" && i + 1 < argc) {
+            workers = std::stoi(argv[++i]);
+            if (workers < 1) {
+                std::cerr << "--workers must be at least 1\n";
+                return 1;
+            }
+        } else if (arg == "--config" && i + 1 < argc) {
+            options.config_path = argv[++i];
+        } else if (arg == "--lazy-graphs") {
+            options.lazy_keyframe_rounds = GRAPH_KEYFRAME_ROUNDS;
+            if (i + 1 < argc && argv[i + 1][0] != '-') options.lazy_keyframe_rounds = std::stoi(argv[++i]);
+            if (options.lazy_keyframe_rounds < 1) {
+                std::cerr << "--lazy-graphs keyframe interval must be at least 1 round\n";
+                return 1;
+            }
+        } else if (arg == "--shm" && i + 1 < argc) {
+            options.shm_name = argv[++i];
+            if (options.shm_name[0] != '/') options.shm_name = "/" + options.shm_name;
+        } else if (arg == "--unix" && i + 1 < argc) {
+            std::string type = argv[++i];
+            if (type == "dgram") options.local_socket = LocalSocketType::Datagram;
+            else if (type == "seqpacket") options.local_socket = LocalSocketType::SeqPacket;
+            else {
+                std::cerr << "--unix takes 'dgram' or 'seqpacket'\n";
+                return 1;
+            }
+            if (i + 1 < argc && argv[i + 1][0] != '-') options.local_socket_dir = argv[++i];
+        } else if (arg == "--timestamps") {
+            options.timestamps = true;
+        } else if (arg == "--crc") {
+            options.crc = true;
+        } else if (arg == "--endpoints" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "address") options.endpoints = EndpointMode::Address;
+            else if (mode == "port") options.endpoints = EndpointMode::Port;
+            else {
+                std::cerr << "--endpoints takes 'address' or 'port'\n";
+                return 1;
+            }
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            std::cerr << "Usage: node-announcer [--nodes N] [--routing [queries per tick]] [--endpoints address|port] [--timestamps] [--crc]\n"
+                      << "                     [--graph-model random|evolving] [--history ticks per node]\n"
+                      << "                     [--fixed-point [seed]] [--checkpoint file [--checkpoint-interval s]] [--restore file]\n"
+                      << "                     [--config file] [--lazy-graphs [keyframe rounds]] [--shm name]\n"
+                      << "                     [--unix dgram|seqpacket [directory]]\n"
+                      << "       node-announcer --sweep \"nodes=20,2000;rate=10,50;edges=6-35;transport=udp,null\"\n"
+                      << "                      [--sweep-out file.csv] [--sweep-duration virtual seconds] [--sweep-cores per run]\n"
+                      << "       node-announcer --scenario \"name=a;nodes=50;rate=10;edges=6-35;weight=1;quota=100\" [--scenario ...]\n"
+                      << "                      [--workers N]\n";
+            return 1;
+        }
+    }
+
+    if (options.local_socket != LocalSocketType::None && options.endpoints != EndpointMode::None) {
+        std::cerr << "--unix and --endpoints both replace the UDP sockets, pick one\n";
+        return 1;
+    }
+    if (!sweep_spec.empty()) return runSweep(sweep_spec, sweep_out, sweep_duration, sweep_cores);
+    if (!scenario_specs.empty()) return runScenarios(scenario_specs, workers);
+
+    if (!options.restore_path.empty()) {
+        // the checkpoint decides the shape of the world
+        try {
+            checkpointer.restoreFrom(options.restore_path);
+            NodeManager::CheckpointState node_state;
+            GraphGenerator::CheckpointState graph_state;
+            checkpointer.restorePoint()->read(BLOCK_NODE_STATE, node_state);
+            checkpointer.restorePoint()->read(BLOCK_GRAPH_STATE, graph_state);
+            options.num_nodes = node_state.num_nodes;
+            options.fixed_point = node_state.fixed_point;
+            options.graph_model = (GraphModel)graph_state.model;
+        } catch (const std::exception& e) {
+            std::cerr << "Restore error: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Restoring " << options.num_nodes << " nodes from " << options.restore_path << "\n";
+    }
+    if (!options.checkpoint_path.empty()) checkpointer.enable(options.checkpoint_path);
+    if (!options.config_path.empty()) {
+        try {
+            std::atomic_store(&runtime_config, loadRuntimeConfig(options.config_path));
+        } catch (const std::exception& e) {
+            std::cerr << "Config error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Starting UDP servers...\n";
+    if (options.crc) std::cout << "CRC32C trailers on, " << (crc32cAccelerated() ? "SSE4.2" : "software") << " checksums\n";
+    topology.resize(options.num_nodes);
+    history.resize(options.num_nodes, options.history_length);
+    if (options.history_length) {
+        std::cout << "Position history: " << options.history_length << " ticks per node, " << history.bytes() / 1024 << " KiB\n";
+    }
+
+    std::unique_ptr<EndpointPool> endpoints;
+    if (options.endpoints != EndpointMode::None) {
+        try {
+            endpoints.reset(new EndpointPool(options.num_nodes, options.endpoints));
+        } catch (const std::exception& e) {
+            std::cerr << "Endpoint setup error: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Virtual endpoints: " << options.num_nodes << " sockets\n";
+    }
+    
+    std::unique_ptr<ShmRegion> shm;
+    if (!options.shm_name.empty()) {
+        try {
+            shm.reset(new ShmRegion(options.shm_name, options.num_nodes));
+        } catch (const std::exception& e) {
+            std::cerr << "Shared memory setup error: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Shared memory " << options.shm_name << ": " << shm->bytes() / 1024 << " KiB, " << SHM_RING_SLOTS << " message ring\n";
+    }
+    
+    std::thread pos_thread(positionServer, std::cref(options), endpoints.get(), shm.get());
+    std::thread graph_thread(graphServer, std::cref(options), endpoints.get(), shm.get());
+    std::thread clock_thread(clockServer);
+    std::thread control_thread;
+    if (options.history_length || options.lazy_keyframe_rounds) control_thread = std::thread(controlServer);
+    std::thread spatial_thread(spatialServer);
+    std::thread checkpoint_thread;
+    if (checkpointer.enabled()) checkpoint_thread = std::thread(checkpointServer, options.checkpoint_interval);
+    std::thread config_thread;
+    if (!options.config_path.empty()) config_thread = std::thread(configServer, options.config_path);
+    std::thread routing_thread;
+    if (options.routing_queries) routing_thread = std::thread(routingServer, options.routing_queries);
+    
+    std::cout << "Servers running. Press Enter to stop...\n";
+    std::cout << "Check of float: " << sizeof(float) << "bytes\n";
+    
+    std::cin.get();
+
+     running = false;
+
+    // Join threads
     if (pos_thread.joinable()) pos_thread.join();
     if (graph_thread.joinable()) graph_thread.join();
+    if (clock_thread.joinable()) clock_thread.join();
+    if (control_thread.joinable()) control_thread.join();
+    if (spatial_thread.joinable()) spatial_thread.join();
+    if (checkpoint_thread.joinable()) checkpoint_thread.join();
+    if (config_thread.joinable()) config_thread.join();
+    if (routing_thread.joinable()) routing_thread.join();
+    if (endpoints) {
+        std::cout << "Virtual endpoints sent " << endpoints->sentCount() << " datagrams, dropped " << endpoints->droppedCount() << "\n";
+    }
 
     std::cout << "Servers stopped. Exiting cleanly.\n";
     return 0;
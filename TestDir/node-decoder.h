@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "crc32c.h"
+
+// Wire layouts of node-announcer's position and graph streams and of DIS entity
+// state PDUs, with the checks a consumer runs before trusting a datagram.
+// Shared by node-receiver and the node_decoder Python module, so both accept
+// exactly the same datagrams.
+
+struct GraphEdge {
+    uint16_t source_id;
+    uint16_t target_id;
+    uint16_t strength;
+};
+
+struct GraphPacket {
+    uint16_t sender_id;
+    uint16_t edge_count;
+    GraphEdge edges[50];
+};
+
+constexpr size_t POSITION_SIZE = sizeof(uint16_t) + 2 * sizeof(float); // node_id, x, y without padding
+constexpr size_t TIMESTAMP_SIZE = sizeof(int64_t);
+constexpr size_t GRAPH_HEADER_SIZE = 2 * sizeof(uint16_t);
+constexpr size_t MAX_PACKET_EDGES = sizeof(GraphPacket::edges) / sizeof(GraphEdge);
+constexpr size_t MAX_DATAGRAM_SIZE = sizeof(GraphPacket) + 16;
+
+enum DecodeStream { STREAM_POSITIONS = 0, STREAM_GRAPHS = 1 };
+
+enum class DatagramCheck { Ok, Malformed, CrcFailure };
+
+// The announcer appends its send time after the payload when run with
+// --timestamps; the payload's own size tells whether it is there.
+inline bool payloadSize(int stream, const char* data, size_t size, size_t& payload) {
+    if (stream == STREAM_POSITIONS) {
+        payload = POSITION_SIZE;
+        return size == POSITION_SIZE || size == POSITION_SIZE + TIMESTAMP_SIZE;
+    }
+    if (size < GRAPH_HEADER_SIZE) return false;
+    uint16_t edge_count;
+    std::memcpy(&edge_count, data + sizeof(uint16_t), sizeof(edge_count));
+    payload = GRAPH_HEADER_SIZE + edge_count * sizeof(GraphEdge);
+    return edge_count <= MAX_PACKET_EDGES && (size == payload || size == payload + TIMESTAMP_SIZE);
+}
+
+// Checks one datagram of a stream. With `crc` the trailer is verified before
+// anything in the datagram is trusted, sizes included, and then cut off `size`.
+inline DatagramCheck checkDatagram(int stream, const char* data, size_t& size, bool crc, size_t& payload) {
+    if (crc) {
+        if (!checkCrc32c(data, size)) return DatagramCheck::CrcFailure;
+        size -= CRC32C_SIZE;
+    }
+    return payloadSize(stream, data, size, payload) ? DatagramCheck::Ok : DatagramCheck::Malformed;
+}
+
+// The announcer's send time (its clock, ns), or -1 when the datagram has none.
+inline int64_t sendTimestamp(const char* data, size_t size, size_t payload) {
+    if (size != payload + TIMESTAMP_SIZE) return -1;
+    int64_t sent_ns;
+    std::memcpy(&sent_ns, data + payload, sizeof(sent_ns));
+    return sent_ns;
+}
+
+// DIS 7 entity state PDU, as node_sender.py sends them (big endian). Only the
+// fields the listener shows are decoded.
+#define DIS_PDU_ENTITY_STATE 1
+constexpr size_t DIS_PDU_TYPE_OFFSET = 2;
+constexpr size_t ESPDU_ENTITY_ID_OFFSET = 12;    // site, application, entity
+constexpr size_t ESPDU_LOCATION_OFFSET = 48;     // ECEF x, y, z in metres, doubles
+constexpr size_t ESPDU_ORIENTATION_OFFSET = 72;  // psi, theta, phi in radians, floats
+constexpr size_t ESPDU_MIN_SIZE = 144;           // without variable parameters
+
+struct EntityState {
+    uint16_t site;
+    uint16_t application;
+    uint16_t entity;
+    double x, y, z;
+    float psi, theta, phi;
+};
+
+namespace node_decoder_detail {
+
+inline uint64_t bigEndian(const char* data, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) value = value << 8 | (uint8_t)data[i];
+    return value;
+}
+
+inline double bigEndianDouble(const char* data) {
+    uint64_t bits = bigEndian(data, 8);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline float bigEndianFloat(const char* data) {
+    uint32_t bits = (uint32_t)bigEndian(data, 4);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+} // namespace node_decoder_detail
+
+// False for anything but an entity state PDU.
+inline bool decodeEntityState(const char* data, size_t size, EntityState& out) {
+    using namespace node_decoder_detail;
+    if (size < ESPDU_MIN_SIZE || (uint8_t)data[DIS_PDU_TYPE_OFFSET] != DIS_PDU_ENTITY_STATE) return false;
+    out.site = (uint16_t)bigEndian(data + ESPDU_ENTITY_ID_OFFSET, 2);
+    out.application = (uint16_t)bigEndian(data + ESPDU_ENTITY_ID_OFFSET + 2, 2);
+    out.entity = (uint16_t)bigEndian(data + ESPDU_ENTITY_ID_OFFSET + 4, 2);
+    out.x = bigEndianDouble(data + ESPDU_LOCATION_OFFSET);
+    out.y = bigEndianDouble(data + ESPDU_LOCATION_OFFSET + 8);
+    out.z = bigEndianDouble(data + ESPDU_LOCATION_OFFSET + 16);
+    out.psi = bigEndianFloat(data + ESPDU_ORIENTATION_OFFSET);
+    out.theta = bigEndianFloat(data + ESPDU_ORIENTATION_OFFSET + 4);
+    out.phi = bigEndianFloat(data + ESPDU_ORIENTATION_OFFSET + 8);
+    return true;
+}
@@ -0,0 +1,590 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <deque>
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+
+#include "node-decoder.h"
+#include "node-shm.h"
+
+#ifdef __linux__
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    #include <unistd.h>
+    #include <poll.h>
+    #include <time.h>
+#endif
+
+// Native receiver for node-announcer's position and graph streams. Datagrams are
+// read in recvmmsg batches with kernel receive timestamps (SO_TIMESTAMPNS), and
+// three latencies are kept as histograms:
+//   end-to-end      announcer send timestamp -> application (needs --timestamps on the announcer)
+//   send-to-kernel  announcer send timestamp -> kernel receive
+//   kernel-to-app   kernel receive -> application, the receive path and our own scheduling
+// With --unix the streams come over the announcer's AF_UNIX sockets instead,
+// datagram for datagram the same; the kernel stamps those as well.
+// With --shm the announcer's shared-memory ring is read instead of the sockets,
+// and kernel-to-app gives way to
+//   publish-to-read announcer publish -> application, both on this host's CLOCK_MONOTONIC
+
+#define POSITION_PORT 12345
+#define GRAPH_PORT 12346
+#define CLOCK_SYNC_PORT 12347
+#define CLOCK_SYNC_MAGIC 0x534B4C43 // "CLKS"
+#define RECV_BATCH 64 // datagrams per recvmmsg
+#define REPORT_INTERVAL_S 5
+#define LOCAL_SOCKET_DIR "/tmp" // as node-announcer --unix
+
+struct ClockSyncPacket {
+    uint32_t magic;
+    uint32_t seq;
+    int64_t t1;
+    int64_t t2;
+    int64_t t3;
+};
+
+std::atomic<bool> running{true};
+
+// Log-linear latency histogram: 16 sub-buckets per power of two of nanoseconds,
+// so every recorded value is kept to within 1/16 of itself.
+class LatencyHistogram {
+private:
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    std::vector<uint64_t> counts = std::vector<uint64_t>(BUCKETS);
+    uint64_t total = 0;
+    uint64_t negative = 0; // clock offset larger than the latency itself
+    int64_t max_ns = 0;
+    double sum_ns = 0;
+
+    static int bucket(uint64_t ns) {
+        if (ns < SUB_BUCKETS) return (int)ns;
+        int magnitude = 63 - __builtin_clzll(ns) - SUB_BITS + 1;
+        return magnitude * SUB_BUCKETS + (int)((ns >> (magnitude - 1)) & (SUB_BUCKETS - 1));
+    }
+
+    // Upper bound of a bucket, the value reported for percentiles inside it.
+    static uint64_t bucketLimit(int index) {
+        int magnitude = index / SUB_BUCKETS;
+        uint64_t sub = index % SUB_BUCKETS;
+        if (magnitude == 0) return sub;
+        return ((SUB_BUCKETS + sub + 1) << (magnitude - 1)) - 1;
+    }
+
+public:
+    void record(int64_t ns) {
+        if (ns < 0) {
+            negative++;
+            ns = 0;
+        }
+        counts[bucket(ns)]++;
+        total++;
+        sum_ns += ns;
+        max_ns = std::max(max_ns, ns);
+    }
+
+    uint64_t count() const { return total; }
+
+    int64_t percentile(double q) const {
+        uint64_t rank = (uint64_t)std::ceil(q * total), seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen >= std::max<uint64_t>(rank, 1)) return std::min<int64_t>(bucketLimit(i), max_ns);
+        }
+        return max_ns;
+    }
+
+    void print(const std::string& name) const {
+        if (!total) {
+            std::cout << "  " << name << ": no samples\n";
+            return;
+        }
+        auto us = [](double ns) {
+            char text[32];
+            snprintf(text, sizeof(text), "%.1f", ns / 1000);
+            return std::string(text);
+        };
+        std::cout << "  " << name << " (us): n=" << total << " mean=" << us(sum_ns / total) << " p50=" << us(percentile(0.5))
+                  << " p90=" << us(percentile(0.9)) << " p99=" << us(percentile(0.99)) << " p99.9=" << us(percentile(0.999))
+                  << " max=" << us(max_ns);
+        if (negative) std::cout << " (" << negative << " below zero)";
+        std::cout << "\n";
+    }
+
+    void reset() { *this = LatencyHistogram(); }
+};
+
+#ifdef __linux__
+
+int64_t clockNs(clockid_t clock) {
+    timespec now;
+    clock_gettime(clock, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Offset of the announcer clock against our CLOCK_MONOTONIC, from the side
+// channel exchange of the announcer's clock sync service. Of the last
+// FILTER_WINDOW samples the one with the smallest round trip is trusted. Without
+// replies the offset stays 0, which is exact when both run on the same host.
+class ClockSync {
+private:
+    static constexpr size_t FILTER_WINDOW = 8;
+
+    sockaddr_in announcer{};
+    std::mutex mutex;
+    std::deque<std::pair<int64_t, int64_t>> samples; // (delay, offset)
+    std::atomic<int64_t> offset{0};
+    std::atomic<bool> synced{false};
+
+public:
+    explicit ClockSync(const std::string& address) {
+        announcer.sin_family = AF_INET;
+        announcer.sin_port = htons(CLOCK_SYNC_PORT);
+        if (inet_pton(AF_INET, address.c_str(), &announcer.sin_addr) != 1) {
+            throw std::runtime_error("bad announcer address " + address);
+        }
+    }
+
+    void run() {
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sock < 0) {
+            std::cerr << "Clock sync error: cannot create socket\n";
+            return;
+        }
+        timeval timeout{0, 500000};
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        for (uint32_t seq = 1; running; ++seq) {
+            ClockSyncPacket packet{CLOCK_SYNC_MAGIC, seq, clockNs(CLOCK_MONOTONIC), 0, 0};
+            sendto(sock, &packet, sizeof(packet), 0, (sockaddr*)&announcer, sizeof(announcer));
+            ClockSyncPacket reply;
+            if (recv(sock, &reply, sizeof(reply), 0) == (ssize_t)sizeof(reply) && reply.magic == CLOCK_SYNC_MAGIC &&
+                reply.seq == seq && reply.t1 == packet.t1) {
+                int64_t t4 = clockNs(CLOCK_MONOTONIC);
+                int64_t delay = (t4 - reply.t1) - (reply.t3 - reply.t2);
+                int64_t sample = ((reply.t2 - reply.t1) + (reply.t3 - t4)) / 2;
+                std::lock_guard<std::mutex> guard(mutex);
+                samples.push_back({delay, sample});
+                if (samples.size() > FILTER_WINDOW) samples.pop_front();
+                offset = std::min_element(samples.begin(), samples.end())->second;
+                synced = true;
+            }
+            // a burst to converge at startup, then once a second
+            std::this_thread::sleep_for(std::chrono::milliseconds(seq < FILTER_WINDOW ? 50 : 1000));
+        }
+        close(sock);
+    }
+
+    int64_t announcerOffset() const { return offset; }
+    bool isSynced() const { return synced; }
+};
+
+struct StreamStats {
+    uint64_t datagrams = 0;
+    uint64_t bytes = 0;
+    uint64_t malformed = 0;
+    uint64_t crc_failures = 0;
+    uint64_t batches = 0;
+    uint64_t edges = 0;
+};
+
+class Receiver {
+private:
+    static constexpr const char* STREAM_NAMES[2] = {"position", "graph"};
+
+    struct Slot {
+        char data[MAX_DATAGRAM_SIZE];
+        char control[CMSG_SPACE(sizeof(timespec))];
+        iovec iov;
+    };
+
+    int sockets[2] = {-1, -1}; // positions, graphs
+    std::string bound_paths[2]; // unix datagram paths we bound and remove again
+    std::string local_type;     // seqpacket: reconnect to local_paths once the announcer hangs up
+    std::string local_paths[2];
+    std::vector<Slot> slots = std::vector<Slot>(RECV_BATCH);
+    mmsghdr messages[RECV_BATCH];
+    ClockSync* clock_sync;
+    bool crc; // every datagram must end in a valid CRC32C trailer
+    std::mutex mutex; // guards what report() reads
+    StreamStats streams[2];
+    LatencyHistogram end_to_end, send_to_kernel, kernel_to_app, publish_to_read;
+    uint64_t missing_kernel_timestamps = 0;
+    ShmRegion* shm = nullptr;
+    uint64_t shm_lost = 0;
+
+    static int openStream(const std::string& bind_address, int port) {
+        int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (sock < 0) throw std::runtime_error("Failed to create socket");
+        int enable = 1;
+        if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0) {
+            throw std::runtime_error("Failed to enable SO_TIMESTAMPNS");
+        }
+        int buffer = 4 << 20;
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, bind_address.c_str(), &addr.sin_addr);
+        if (bind(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(sock);
+            throw std::runtime_error("Failed to bind port " + std::to_string(port) + ": " + strerror(errno));
+        }
+        return sock;
+    }
+
+    // Counts one datagram and checks it; on success `size` has lost its CRC
+    // trailer. The caller holds the mutex.
+    bool countDatagram(int stream, const char* data, size_t& size, bool truncated, size_t& payload) {
+        StreamStats& stats = streams[stream];
+        stats.datagrams++;
+        stats.bytes += size;
+        if (truncated) {
+            stats.malformed++;
+            return false;
+        }
+        DatagramCheck check = checkDatagram(stream, data, size, crc, payload);
+        if (check == DatagramCheck::CrcFailure) {
+            stats.crc_failures++;
+            return false;
+        }
+        if (check == DatagramCheck::Malformed) {
+            stats.malformed++;
+            return false;
+        }
+        if (stream == STREAM_GRAPHS) stats.edges += (payload - GRAPH_HEADER_SIZE) / sizeof(GraphEdge);
+        return true;
+    }
+
+    // dgram: binds the stream's path, which the announcer sends to.
+    // seqpacket: connects to the announcer, which listens on it.
+    static int openLocalStream(const std::string& type, const std::string& path) {
+        sockaddr_un addr{};
+        if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("unix socket path too long: " + path);
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        bool datagram = type == "dgram";
+        int sock = socket(AF_UNIX, (datagram ? SOCK_DGRAM : SOCK_SEQPACKET) | SOCK_NONBLOCK, 0);
+        if (sock < 0) throw std::runtime_error("Failed to create unix socket");
+        int enable = 1;
+        setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+        int buffer = 4 << 20;
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+        if (datagram) unlink(path.c_str());
+        if ((datagram ? bind(sock, (sockaddr*)&addr, sizeof(addr)) : connect(sock, (sockaddr*)&addr, sizeof(addr))) < 0) {
+            close(sock);
+            throw std::runtime_error("Failed to " + std::string(datagram ? "bind " : "connect to ") + path + ": " + strerror(errno));
+        }
+        return sock;
+    }
+
+    void decodeBatch(int stream, int count) {
+        // one clock read per batch: what the application sees is the batch's arrival
+        int64_t app_realtime = clockNs(CLOCK_REALTIME);
+        int64_t app_announcer = clockNs(CLOCK_MONOTONIC) + clock_sync->announcerOffset();
+
+        std::lock_guard<std::mutex> guard(mutex);
+        streams[stream].batches++;
+        for (int i = 0; i < count; ++i) {
+            const msghdr& header = messages[i].msg_hdr;
+            const char* data = slots[i].data;
+            size_t size = messages[i].msg_len;
+            size_t payload;
+            if (!countDatagram(stream, data, size, header.msg_flags & MSG_TRUNC, payload)) continue;
+
+            int64_t kernel_ns = -1;
+            for (cmsghdr* cmsg = CMSG_FIRSTHDR(&header); cmsg; cmsg = CMSG_NXTHDR((msghdr*)&header, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                    timespec stamp;
+                    std::memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+                    kernel_ns = (int64_t)stamp.tv_sec * 1000000000 + stamp.tv_nsec;
+                }
+            }
+            if (kernel_ns < 0) {
+                missing_kernel_timestamps++;
+            } else {
+                kernel_to_app.record(app_realtime - kernel_ns);
+            }
+
+            int64_t sent_ns = sendTimestamp(data, size, payload);
+            if (sent_ns >= 0) {
+                int64_t latency = app_announcer - sent_ns;
+                end_to_end.record(latency);
+                // the kernel stamp is wall clock, so the wire share is what remains
+                if (kernel_ns >= 0) send_to_kernel.record(latency - (app_realtime - kernel_ns));
+            }
+        }
+    }
+
+    // Returns what recvmmsg returned.
+    int receive(int stream) {
+        for (int i = 0; i < RECV_BATCH; ++i) {
+            Slot& slot = slots[i];
+            slot.iov = {slot.data, sizeof(slot.data)};
+            messages[i] = {};
+            messages[i].msg_hdr.msg_iov = &slot.iov;
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_control = slot.control;
+            messages[i].msg_hdr.msg_controllen = sizeof(slot.control);
+        }
+        int count = recvmmsg(sockets[stream], messages, RECV_BATCH, MSG_DONTWAIT, nullptr);
+        // a seqpacket stream at end of file reads as empty messages: what came
+        // before them is decoded, and the read counts as empty
+        if (count > 0 && local_type == "seqpacket") {
+            int sent = 0;
+            while (sent < count && messages[sent].msg_len) ++sent;
+            if (sent < count) {
+                if (sent) decodeBatch(stream, sent);
+                return 0;
+            }
+        }
+        if (count > 0) decodeBatch(stream, count);
+        return count;
+    }
+
+    // A seqpacket stream whose announcer went away is closed, and run() connects
+    // it again once a second until the announcer listens again.
+    void hangUp(int stream) {
+        close(sockets[stream]);
+        sockets[stream] = -1;
+        std::cout << "Announcer closed the " << STREAM_NAMES[stream] << " stream, reconnecting\n";
+    }
+
+    void reconnect(int stream) {
+        try {
+            sockets[stream] = openLocalStream(local_type, local_paths[stream]);
+            std::cout << "Reconnected the " << STREAM_NAMES[stream] << " stream\n";
+        } catch (const std::exception&) {
+        }
+    }
+
+    // Whatever is in the ring once a message arrives is taken as one batch,
+    // under one lock and one clock read.
+    void runShm() {
+        ShmReader reader(*shm);
+        ShmMessage message;
+        while (running) {
+            if (!reader.read(message, 200)) continue;
+            int64_t now = clockNs(CLOCK_MONOTONIC);
+            std::lock_guard<std::mutex> guard(mutex);
+            bool batched[2] = {false, false};
+            int taken = 0;
+            do {
+                int stream = message.stream == SHM_GRAPHS ? STREAM_GRAPHS : STREAM_POSITIONS;
+                if (!batched[stream]) streams[stream].batches++;
+                batched[stream] = true;
+                publish_to_read.record(now - message.published_ns);
+                size_t size = message.size, payload;
+                if (!countDatagram(stream, message.data, size, false, payload)) continue;
+                int64_t sent_ns = sendTimestamp(message.data, size, payload);
+                if (sent_ns >= 0) end_to_end.record(now + clock_sync->announcerOffset() - sent_ns);
+            } while (++taken < RECV_BATCH && reader.poll(message));
+            shm_lost = reader.lostCount();
+        }
+    }
+
+public:
+    Receiver(const std::string& bind_address, ClockSync* sync, bool check_crc) : clock_sync(sync), crc(check_crc) {
+        sockets[0] = openStream(bind_address, POSITION_PORT);
+        sockets[1] = openStream(bind_address, GRAPH_PORT);
+    }
+
+    Receiver(const std::string& local_type, const std::string& directory, ClockSync* sync, bool check_crc)
+        : clock_sync(sync), crc(check_crc) {
+        std::string paths[2] = {directory + "/node-positions.sock", directory + "/node-graphs.sock"};
+        for (int stream = 0; stream < 2; ++stream) {
+            sockets[stream] = openLocalStream(local_type, paths[stream]);
+            if (local_type == "dgram") bound_paths[stream] = paths[stream];
+            local_paths[stream] = paths[stream];
+        }
+        this->local_type = local_type;
+    }
+
+    Receiver(ShmRegion* region, ClockSync* sync, bool check_crc) : clock_sync(sync), crc(check_crc), shm(region) {}
+
+    ~Receiver() {
+        for (int sock : sockets) {
+            if (sock >= 0) close(sock);
+        }
+        for (const std::string& path : bound_paths) {
+            if (!path.empty()) unlink(path.c_str());
+        }
+    }
+
+    void run() {
+        if (shm) {
+            runShm();
+            return;
+        }
+        pollfd fds[2] = {{sockets[0], POLLIN, 0}, {sockets[1], POLLIN, 0}};
+        auto last_attempt = std::chrono::steady_clock::now();
+        while (running) {
+            if (sockets[0] < 0 || sockets[1] < 0) {
+                auto now = std::chrono::steady_clock::now();
+                if (now - last_attempt >= std::chrono::seconds(1)) {
+                    last_attempt = now;
+                    for (int stream = 0; stream < 2; ++stream) {
+                        if (sockets[stream] < 0) reconnect(stream);
+                    }
+                }
+            }
+            // poll skips the negative descriptors of streams waiting to reconnect
+            for (int stream = 0; stream < 2; ++stream) fds[stream].fd = sockets[stream];
+            if (poll(fds, 2, 200) <= 0) continue;
+            for (int stream = 0; stream < 2; ++stream) {
+                short events = fds[stream].revents;
+                // queued datagrams are read first; an empty read or a bare hangup is the end
+                int count = events & POLLIN ? receive(stream) : -1;
+                bool ended = count == 0 || (count < 0 && (events & (POLLHUP | POLLERR)));
+                if (ended && local_type == "seqpacket") {
+                    last_attempt = std::chrono::steady_clock::now();
+                    hangUp(stream);
+                }
+            }
+        }
+    }
+
+    // Prints and clears the interval's counters and histograms.
+    void report(double seconds) {
+        std::lock_guard<std::mutex> guard(mutex);
+        const char* names[2] = {"Positions", "Graphs"};
+        for (int stream = 0; stream < 2; ++stream) {
+            const StreamStats& stats = streams[stream];
+            std::cout << names[stream] << ": " << stats.datagrams << " datagrams (" << (uint64_t)(stats.datagrams / seconds) << "/s), "
+                      << stats.bytes << " bytes, " << (stats.batches ? stats.datagrams / (double)stats.batches : 0.0)
+                      << " per batch, " << stats.malformed << " malformed";
+            if (crc) std::cout << ", " << stats.crc_failures << " failed CRC";
+            if (stream == 1) std::cout << ", " << stats.edges << " edges";
+            std::cout << "\n";
+            streams[stream] = StreamStats();
+        }
+        std::cout << "Latency, clock offset " << clock_sync->announcerOffset() << " ns"
+                  << (clock_sync->isSynced() ? "" : " (not synced, same host assumed)") << ":\n";
+        end_to_end.print("end-to-end");
+        if (shm) {
+            publish_to_read.print("publish-to-read");
+            ShmPoint point;
+            int64_t snapshot_ns;
+            uint64_t tick = shm->readSnapshot(&point, 1, snapshot_ns);
+            std::cout << "  snapshot at tick " << tick << ", " << (clockNs(CLOCK_MONOTONIC) - snapshot_ns) / 1000000
+                      << " ms old; " << shm_lost << " messages lost to lapping\n";
+        } else {
+            send_to_kernel.print("send-to-kernel");
+            kernel_to_app.print("kernel-to-app");
+        }
+        if (missing_kernel_timestamps) std::cout << "  " << missing_kernel_timestamps << " datagrams without kernel timestamp\n";
+        end_to_end.reset();
+        send_to_kernel.reset();
+        kernel_to_app.reset();
+        publish_to_read.reset();
+        missing_kernel_timestamps = 0;
+    }
+};
+
+int main(int argc, char** argv) {
+    std::string bind_address = "0.0.0.0", announcer = "127.0.0.1", shm_name, local_type, local_dir = LOCAL_SOCKET_DIR;
+    bool clock_sync_enabled = true;
+    bool crc = false;
+    double duration = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--bind" && i + 1 < argc) {
+            bind_address = argv[++i];
+        } else if (arg == "--announcer" && i + 1 < argc) {
+            announcer = argv[++i];
+        } else if (arg == "--crc") {
+            crc = true;
+        } else if (arg == "--no-clock-sync") {
+            clock_sync_enabled = false;
+        } else if (arg == "--duration" && i + 1 < argc) {
+            duration = std::stod(argv[++i]);
+        } else if (arg == "--unix" && i + 1 < argc) {
+            local_type = argv[++i];
+            if (local_type != "dgram" && local_type != "seqpacket") {
+                std::cerr << "--unix takes 'dgram' or 'seqpacket'\n";
+                return 1;
+            }
+            if (i + 1 < argc && argv[i + 1][0] != '-') local_dir = argv[++i];
+        } else if (arg == "--shm" && i + 1 < argc) {
+            shm_name = argv[++i];
+            if (shm_name[0] != '/') shm_name = "/" + shm_name;
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            std::cerr << "Usage: node-receiver [--bind address] [--announcer address] [--no-clock-sync] [--crc] [--duration s]\n"
+                      << "                     [--unix dgram|seqpacket [directory]] [--shm name]\n";
+            return 1;
+        }
+    }
+
+    try {
+        ClockSync clock_sync(announcer);
+        std::unique_ptr<ShmRegion> shm;
+        if (!shm_name.empty()) shm.reset(new ShmRegion(shm_name));
+        std::unique_ptr<Receiver> receiver;
+        if (shm) {
+            receiver.reset(new Receiver(shm.get(), &clock_sync, crc));
+        } else if (!local_type.empty()) {
+            receiver.reset(new Receiver(local_type, local_dir, &clock_sync, crc));
+        } else {
+            receiver.reset(new Receiver(bind_address, &clock_sync, crc));
+        }
+        if (crc) std::cout << "Verifying CRC32C trailers with " << (crc32cAccelerated() ? "SSE4.2" : "software") << " checksums\n";
+        std::thread sync_thread;
+        if (clock_sync_enabled) sync_thread = std::thread(&ClockSync::run, &clock_sync);
+        std::thread receive_thread(&Receiver::run, receiver.get());
+        std::thread stop_thread;
+        if (duration <= 0) {
+            if (shm) {
+                std::cout << "Reading shared memory " << shm_name << ". Press Enter to stop...\n";
+            } else if (!local_type.empty()) {
+                std::cout << "Receiving on unix " << local_type << " sockets in " << local_dir << ". Press Enter to stop...\n";
+            } else {
+                std::cout << "Receiving on ports " << POSITION_PORT << " and " << GRAPH_PORT << ". Press Enter to stop...\n";
+            }
+            stop_thread = std::thread([] {
+                std::cin.get();
+                running = false;
+            });
+            stop_thread.detach();
+        }
+
+        auto start = std::chrono::steady_clock::now(), last = start;
+        while (running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            auto now = std::chrono::steady_clock::now();
+            if (duration > 0 && now - start >= std::chrono::duration<double>(duration)) running = false;
+            if (now - last >= std::chrono::seconds(REPORT_INTERVAL_S) || !running) {
+                receiver->report(std::chrono::duration<double>(now - last).count());
+                last = now;
+            }
+        }
+        receive_thread.join();
+        if (sync_thread.joinable()) sync_thread.join();
+    } catch (const std::exception& e) {
+        std::cerr << "Receiver error: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Receiver stopped.\n";
+    return 0;
+}
+
+#else
+
+int main() {
+    std::cerr << "node-receiver needs Linux (recvmmsg, SO_TIMESTAMPNS)\n";
+    return 1;
+}
+
+#endif
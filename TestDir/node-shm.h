@@ -0,0 +1,298 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+#ifdef __linux__
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/syscall.h>
+    #include <linux/futex.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <climits>
+    #include <ctime>
+    #include <cerrno>
+#endif
+
+// Shared-memory transport between node-announcer (--shm name) and readers on
+// the same host (node-receiver --shm name). One shm_open region holds:
+//   a world snapshot  every node's position after the last position tick,
+//                     behind a seqlock: readers copy it and retry if a tick
+//                     was written meanwhile
+//   a message ring    every datagram of both streams, framed as on the wire,
+//                     in SHM_RING_SLOTS fixed slots. Writers (the position and
+//                     graph threads) reserve slots with one atomic add; each
+//                     slot has its own sequence word, so readers need no lock
+//                     and never hold writers back. A reader that falls a whole
+//                     ring behind skips ahead and counts what it lost.
+// Readers poll the ring while messages flow and only sleep on a futex in the
+// region when it runs dry; writers make the wake-up call only while someone
+// sleeps. Neither side makes a system call per message.
+
+#define SHM_MAGIC 0x4D48534E // "NSHM"
+#define SHM_VERSION 1
+#define SHM_RING_SLOTS 65536 // messages kept in the ring, a power of two
+#define SHM_SLOT_SIZE 384    // bytes per ring slot, header included
+#define SHM_SPIN 4096        // empty polls before a reader sleeps
+
+enum ShmStream : uint32_t { SHM_POSITIONS = 0, SHM_GRAPHS = 1 }; // same numbering as node-decoder.h
+
+struct ShmPoint {
+    float x;
+    float y;
+};
+
+struct ShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_nodes;
+    uint32_t ring_slots;
+    uint64_t snapshot_offset; // num_nodes + 1 ShmPoints, indexed by node id
+    uint64_t ring_offset;     // ring_slots ShmSlots
+    uint64_t size;
+    alignas(64) std::atomic<uint32_t> snapshot_seq; // odd while the snapshot is written
+    uint64_t snapshot_tick;
+    int64_t snapshot_ns;
+    alignas(64) std::atomic<uint64_t> head;      // messages reserved so far
+    alignas(64) std::atomic<uint32_t> published; // futex word, bumped after every message
+    std::atomic<uint32_t> waiters;               // readers asleep on it
+};
+
+struct ShmSlot {
+    std::atomic<uint64_t> seq; // 2n + 1 while message n is written, 2n + 2 once it is complete
+    uint32_t stream;           // ShmStream
+    uint32_t size;
+    int64_t published_ns; // CLOCK_MONOTONIC, the announcer's clock
+    char data[SHM_SLOT_SIZE - 24];
+};
+
+static_assert(sizeof(ShmSlot) == SHM_SLOT_SIZE, "ring slots must stay packed");
+static_assert((SHM_RING_SLOTS & (SHM_RING_SLOTS - 1)) == 0, "ring size must be a power of two");
+
+struct ShmMessage {
+    uint32_t stream;
+    uint32_t size;
+    int64_t published_ns;
+    char data[sizeof(ShmSlot::data)];
+};
+
+#ifdef __linux__
+
+class ShmRegion {
+private:
+    std::string name;
+    bool owner;
+    int fd = -1;
+    size_t size = 0;
+    char* base = nullptr;
+
+    static size_t align(size_t offset) { return (offset + 63) & ~(size_t)63; }
+
+    void map(int prot) {
+        base = (char*)mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            base = nullptr;
+            close(fd);
+            throw std::runtime_error("Failed to map shared memory " + name + ": " + strerror(errno));
+        }
+    }
+
+    static long futex(std::atomic<uint32_t>* word, int op, uint32_t value, const timespec* timeout) {
+        return syscall(SYS_futex, (uint32_t*)word, op, value, timeout, nullptr, 0);
+    }
+
+public:
+    // Creates the region for num_nodes nodes, replacing any left by an earlier run.
+    ShmRegion(const std::string& region_name, int num_nodes) : name(region_name), owner(true) {
+        shm_unlink(name.c_str());
+        fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) throw std::runtime_error("Failed to create shared memory " + name + ": " + strerror(errno));
+        size_t snapshot_offset = align(sizeof(ShmHeader));
+        size_t ring_offset = align(snapshot_offset + (num_nodes + 1) * sizeof(ShmPoint));
+        size = ring_offset + (size_t)SHM_RING_SLOTS * sizeof(ShmSlot);
+        if (ftruncate(fd, size) < 0) {
+            close(fd);
+            shm_unlink(name.c_str());
+            throw std::runtime_error("Failed to size shared memory " + name + ": " + strerror(errno));
+        }
+        map(PROT_READ | PROT_WRITE);
+        ShmHeader* h = new (base) ShmHeader();
+        h->num_nodes = num_nodes;
+        h->ring_slots = SHM_RING_SLOTS;
+        h->snapshot_offset = snapshot_offset;
+        h->ring_offset = ring_offset;
+        h->size = size;
+        h->version = SHM_VERSION;
+        std::atomic_thread_fence(std::memory_order_release);
+        h->magic = SHM_MAGIC; // last: readers check it before trusting the rest
+    }
+
+    // Attaches to a region created by a running announcer.
+    explicit ShmRegion(const std::string& region_name) : name(region_name), owner(false) {
+        fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) throw std::runtime_error("Failed to open shared memory " + name + ": " + strerror(errno));
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ShmHeader)) {
+            close(fd);
+            throw std::runtime_error("Shared memory " + name + " is not an announcer region");
+        }
+        size = st.st_size;
+        map(PROT_READ | PROT_WRITE); // readers register as futex waiters
+        const ShmHeader* h = header();
+        if (h->magic != SHM_MAGIC || h->version != SHM_VERSION || h->size != size || h->ring_slots != SHM_RING_SLOTS) {
+            munmap(base, size);
+            close(fd);
+            throw std::runtime_error("Shared memory " + name + " has an unknown layout");
+        }
+    }
+
+    ~ShmRegion() {
+        if (base) munmap(base, size);
+        if (fd >= 0) close(fd);
+        if (owner) shm_unlink(name.c_str());
+    }
+
+    ShmRegion(const ShmRegion&) = delete;
+    ShmRegion& operator=(const ShmRegion&) = delete;
+
+    ShmHeader* header() const { return (ShmHeader*)base; }
+    ShmPoint* points() const { return (ShmPoint*)(base + header()->snapshot_offset); }
+    ShmSlot* slots() const { return (ShmSlot*)(base + header()->ring_offset); }
+    size_t bytes() const { return size; }
+
+    // Writer side. The snapshot's points may be filled between begin and end.
+    ShmPoint* beginSnapshot() {
+        header()->snapshot_seq.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return points();
+    }
+
+    void endSnapshot(uint64_t tick, int64_t now_ns) {
+        header()->snapshot_tick = tick;
+        header()->snapshot_ns = now_ns;
+        header()->snapshot_seq.fetch_add(1, std::memory_order_release);
+        wake();
+    }
+
+    void publish(uint32_t stream, const void* data, size_t size, int64_t now_ns) {
+        if (size > sizeof(ShmSlot::data)) return;
+        ShmHeader* h = header();
+        uint64_t n = h->head.fetch_add(1, std::memory_order_relaxed);
+        ShmSlot& slot = slots()[n & (SHM_RING_SLOTS - 1)];
+        slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.stream = stream;
+        slot.size = size;
+        slot.published_ns = now_ns;
+        std::memcpy(slot.data, data, size);
+        slot.seq.store(2 * n + 2, std::memory_order_release);
+        wake();
+    }
+
+    void wake() {
+        ShmHeader* h = header();
+        h->published.fetch_add(1);
+        if (h->waiters.load()) futex(&h->published, FUTEX_WAKE, INT_MAX, nullptr);
+    }
+
+    // Reader side. Copies the last complete snapshot, indexed by node id.
+    uint64_t readSnapshot(ShmPoint* out, size_t count, int64_t& snapshot_ns) const {
+        const ShmHeader* h = header();
+        count = std::min<size_t>(count, h->num_nodes + 1);
+        for (;;) {
+            uint32_t before = h->snapshot_seq.load(std::memory_order_acquire);
+            if (before & 1) continue;
+            std::memcpy(out, points(), count * sizeof(ShmPoint));
+            uint64_t tick = h->snapshot_tick;
+            snapshot_ns = h->snapshot_ns;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (h->snapshot_seq.load(std::memory_order_relaxed) == before) return tick;
+        }
+    }
+
+    // Sleeps until something is published or timeout_ms passes, unless ready()
+    // turns true once registered as a waiter.
+    template <typename Ready>
+    void wait(Ready ready, int timeout_ms) {
+        ShmHeader* h = header();
+        h->waiters.fetch_add(1);
+        uint32_t seen = h->published.load();
+        if (!ready()) {
+            timespec timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+            futex(&h->published, FUTEX_WAIT, seen, &timeout);
+        }
+        h->waiters.fetch_sub(1);
+    }
+};
+
+// One reader's position in the ring. Starts at the newest message.
+class ShmReader {
+private:
+    ShmRegion& region;
+    uint64_t next;
+    uint64_t lost = 0;
+
+public:
+    explicit ShmReader(ShmRegion& shm) : region(shm), next(shm.header()->head.load()) {}
+
+    // Copies the next message if there is one, skipping ahead when lapped.
+    bool poll(ShmMessage& out) {
+        ShmSlot& slot = region.slots()[next & (SHM_RING_SLOTS - 1)];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq == 2 * next + 2) {
+            out.stream = slot.stream;
+            out.size = std::min<size_t>(slot.size, sizeof(out.data));
+            out.published_ns = slot.published_ns;
+            std::memcpy(out.data, slot.data, out.size);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == seq) {
+                next++;
+                return true;
+            }
+        } else if (seq < 2 * next + 2 && region.header()->head.load(std::memory_order_relaxed) < next + SHM_RING_SLOTS) {
+            return false; // not written yet
+        }
+        // overwritten under us: resume half a ring behind the writers
+        uint64_t resume = region.header()->head.load() - SHM_RING_SLOTS / 2;
+        if (resume <= next) resume = next + 1;
+        lost += resume - next;
+        next = resume;
+        return false;
+    }
+
+    // Waits up to timeout_ms for the next message: polls first, then sleeps.
+    bool read(ShmMessage& out, int timeout_ms) {
+        for (int spin = 0; spin < SHM_SPIN; ++spin) {
+            if (poll(out)) return true;
+        }
+        region.wait([&] { return ready(); }, timeout_ms);
+        return poll(out);
+    }
+
+    bool ready() const {
+        const ShmSlot& slot = region.slots()[next & (SHM_RING_SLOTS - 1)];
+        return slot.seq.load(std::memory_order_acquire) >= 2 * next + 2;
+    }
+
+    uint64_t lostCount() const { return lost; }
+};
+
+#else
+
+class ShmRegion {
+public:
+    ShmRegion(const std::string&, int) { throw std::runtime_error("the shared-memory transport needs futexes (Linux only)"); }
+    size_t bytes() const { return 0; }
+    ShmPoint* beginSnapshot() { return nullptr; }
+    void endSnapshot(uint64_t, int64_t) {}
+    void publish(uint32_t, const void*, size_t, int64_t) {}
+};
+
+#endif
@@ -0,0 +1,421 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <vector>
+#include <initializer_list>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+#include "node-decoder.h"
+
+#ifdef __linux__
+    #include <sys/socket.h>
+#endif
+
+// node_decoder: batch decoding of node-announcer and DIS datagrams for the Python
+// tools, built from the same checks as node-receiver (node-decoder.h).
+//
+// A batch is the datagrams back to back in one buffer plus a buffer of their
+// uint32 lengths, which receive() fills with one recvmmsg per call. Decoding
+// returns a dict of flat columns (Array objects) that export the buffer
+// protocol, so numpy.asarray() or memoryview() use them without copying and no
+// Python object is made per record:
+//
+//   data, lengths = node_decoder.receive(sock)
+//   graphs = node_decoder.decode_graphs(data, lengths)
+//   senders = numpy.asarray(graphs["sender_id"])
+//
+// Build (see compile.txt):
+//   g++ -O2 -shared -fPIC $(python3-config --includes) node_decoder.cpp -o node_decoder$(python3-config --extension-suffix)
+
+#define RECEIVE_BATCH 1024 // default datagrams per receive()
+#define RECEIVE_SLOT 2048  // bytes per datagram; longer ones arrive cut short and fail their checks
+
+// One typed column: a flat C array shown to Python through the buffer protocol.
+struct Array {
+    PyObject_HEAD
+    char* data;
+    Py_ssize_t length;
+    Py_ssize_t itemsize;
+    Py_ssize_t shape[1];
+    Py_ssize_t strides[1];
+    char format[2];
+};
+
+static void arrayDealloc(Array* self) {
+    std::free(self->data);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int arrayGetBuffer(Array* self, Py_buffer* view, int flags) {
+    self->shape[0] = self->length;
+    self->strides[0] = self->itemsize;
+    view->obj = (PyObject*)self;
+    Py_INCREF(self);
+    view->buf = self->data;
+    view->len = self->length * self->itemsize;
+    view->readonly = 0;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? self->format : nullptr;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? self->shape : nullptr;
+    view->strides = (flags & PyBUF_STRIDES) ? self->strides : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = nullptr;
+    return 0;
+}
+
+static Py_ssize_t arrayLength(Array* self) { return self->length; }
+
+static PyObject* arrayRepr(Array* self) {
+    return PyUnicode_FromFormat("<node_decoder.Array format '%s', %zd items>", self->format, self->length);
+}
+
+// filled in by PyInit_node_decoder
+static PyBufferProcs array_buffer;
+static PySequenceMethods array_sequence;
+static PyTypeObject ArrayType;
+
+// A new column of `length` items of the struct module type `format`.
+static Array* newArray(char format, Py_ssize_t itemsize, Py_ssize_t length) {
+    Array* array = PyObject_New(Array, &ArrayType);
+    if (!array) return nullptr;
+    array->data = (char*)std::malloc(length ? length * itemsize : 1);
+    if (!array->data) {
+        Py_TYPE(array)->tp_free((PyObject*)array);
+        return (Array*)PyErr_NoMemory();
+    }
+    array->length = length;
+    array->itemsize = itemsize;
+    array->format[0] = format;
+    array->format[1] = '\0';
+    return array;
+}
+
+template <typename T>
+static T* items(Array* array) { return (T*)array->data; }
+
+// The columns of one decode call, released together on error.
+class Columns {
+private:
+    std::vector<std::pair<const char*, Array*>> columns;
+    bool failed = false;
+
+public:
+    ~Columns() {
+        for (auto& column : columns) Py_XDECREF(column.second);
+    }
+
+    template <typename T>
+    T* add(const char* name, char format, Py_ssize_t length) {
+        Array* array = newArray(format, sizeof(T), length);
+        failed |= !array;
+        columns.push_back({name, array});
+        return array ? items<T>(array) : nullptr;
+    }
+
+    bool ok() const { return !failed; }
+
+    // The dict of columns plus the given counters.
+    PyObject* result(std::initializer_list<std::pair<const char*, Py_ssize_t>> counters) {
+        PyObject* dict = PyDict_New();
+        if (!dict) return nullptr;
+        for (auto& column : columns) {
+            if (PyDict_SetItemString(dict, column.first, (PyObject*)column.second) < 0) {
+                Py_DECREF(dict);
+                return nullptr;
+            }
+        }
+        for (auto& counter : counters) {
+            PyObject* value = PyLong_FromSsize_t(counter.second);
+            if (!value || PyDict_SetItemString(dict, counter.first, value) < 0) {
+                Py_XDECREF(value);
+                Py_DECREF(dict);
+                return nullptr;
+            }
+            Py_DECREF(value);
+        }
+        return dict;
+    }
+};
+
+// The datagrams of a batch: views of the data and lengths buffers.
+class Batch {
+private:
+    Py_buffer data_view{}, lengths_view{};
+    bool have_data = false, have_lengths = false;
+
+public:
+    const char* data = nullptr;
+    const uint32_t* lengths = nullptr;
+    Py_ssize_t count = 0;
+
+    ~Batch() {
+        if (have_data) PyBuffer_Release(&data_view);
+        if (have_lengths) PyBuffer_Release(&lengths_view);
+    }
+
+    bool open(PyObject* data_object, PyObject* lengths_object) {
+        if (PyObject_GetBuffer(data_object, &data_view, PyBUF_SIMPLE) < 0) return false;
+        have_data = true;
+        if (PyObject_GetBuffer(lengths_object, &lengths_view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) return false;
+        have_lengths = true;
+        const char* format = lengths_view.format ? lengths_view.format : "B";
+        if (format[0] == '<' || format[0] == '=' || format[0] == '@') format++;
+        if (lengths_view.itemsize != 4 || (std::strcmp(format, "I") && std::strcmp(format, "L"))) {
+            PyErr_SetString(PyExc_TypeError, "lengths must be a buffer of uint32");
+            return false;
+        }
+        data = (const char*)data_view.buf;
+        lengths = (const uint32_t*)lengths_view.buf;
+        count = lengths_view.len / 4;
+        uint64_t total = 0;
+        for (Py_ssize_t i = 0; i < count; ++i) total += lengths[i];
+        if (total > (uint64_t)data_view.len) {
+            PyErr_SetString(PyExc_ValueError, "lengths add up to more than the data buffer");
+            return false;
+        }
+        return true;
+    }
+};
+
+static bool parseBatch(PyObject* args, PyObject* kwargs, Batch& batch, int* crc) {
+    static const char* keywords[] = {"data", "lengths", "crc", nullptr};
+    PyObject *data, *lengths;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|p", (char**)keywords, &data, &lengths, crc)) return false;
+    return batch.open(data, lengths);
+}
+
+// Checks every datagram of a stream once: payload size per datagram, 0 for the
+// rejected ones, and what was rejected.
+static void checkBatch(int stream, const Batch& batch, bool crc, std::vector<uint32_t>& payloads,
+                       std::vector<uint32_t>& sizes, Py_ssize_t& malformed, Py_ssize_t& crc_failures) {
+    payloads.resize(batch.count);
+    sizes.resize(batch.count);
+    const char* data = batch.data;
+    for (Py_ssize_t i = 0; i < batch.count; data += batch.lengths[i], ++i) {
+        size_t size = batch.lengths[i], payload = 0;
+        DatagramCheck check = checkDatagram(stream, data, size, crc, payload);
+        malformed += check == DatagramCheck::Malformed;
+        crc_failures += check == DatagramCheck::CrcFailure;
+        payloads[i] = check == DatagramCheck::Ok ? payload : 0;
+        sizes[i] = size;
+    }
+}
+
+static PyObject* decodePositions(PyObject*, PyObject* args, PyObject* kwargs) {
+    Batch batch;
+    int crc = 0;
+    if (!parseBatch(args, kwargs, batch, &crc)) return nullptr;
+
+    std::vector<uint32_t> payloads, sizes;
+    Py_ssize_t malformed = 0, crc_failures = 0;
+    checkBatch(STREAM_POSITIONS, batch, crc, payloads, sizes, malformed, crc_failures);
+    Py_ssize_t count = batch.count - malformed - crc_failures;
+
+    Columns columns;
+    uint16_t* node_ids = columns.add<uint16_t>("node_id", 'H', count);
+    float* xs = columns.add<float>("x", 'f', count);
+    float* ys = columns.add<float>("y", 'f', count);
+    int64_t* sent = columns.add<int64_t>("sent_ns", 'q', count);
+    if (!columns.ok()) return nullptr;
+
+    const char* data = batch.data;
+    Py_ssize_t n = 0;
+    for (Py_ssize_t i = 0; i < batch.count; data += batch.lengths[i], ++i) {
+        if (!payloads[i]) continue;
+        std::memcpy(&node_ids[n], data, sizeof(uint16_t));
+        std::memcpy(&xs[n], data + sizeof(uint16_t), sizeof(float));
+        std::memcpy(&ys[n], data + sizeof(uint16_t) + sizeof(float), sizeof(float));
+        sent[n] = sendTimestamp(data, sizes[i], payloads[i]);
+        n++;
+    }
+    return columns.result({{"malformed", malformed}, {"crc_failures", crc_failures}});
+}
+
+static PyObject* decodeGraphs(PyObject*, PyObject* args, PyObject* kwargs) {
+    Batch batch;
+    int crc = 0;
+    if (!parseBatch(args, kwargs, batch, &crc)) return nullptr;
+
+    std::vector<uint32_t> payloads, sizes;
+    Py_ssize_t malformed = 0, crc_failures = 0, edges = 0;
+    checkBatch(STREAM_GRAPHS, batch, crc, payloads, sizes, malformed, crc_failures);
+    for (uint32_t payload : payloads) edges += payload ? (payload - GRAPH_HEADER_SIZE) / sizeof(GraphEdge) : 0;
+    Py_ssize_t count = batch.count - malformed - crc_failures;
+
+    // packet p's edges are [edge_offset[p], edge_offset[p + 1]) of the edge columns
+    Columns columns;
+    uint16_t* sender_ids = columns.add<uint16_t>("sender_id", 'H', count);
+    uint32_t* offsets = columns.add<uint32_t>("edge_offset", 'I', count + 1);
+    int64_t* sent = columns.add<int64_t>("sent_ns", 'q', count);
+    uint16_t* sources = columns.add<uint16_t>("source", 'H', edges);
+    uint16_t* targets = columns.add<uint16_t>("target", 'H', edges);
+    uint16_t* strengths = columns.add<uint16_t>("strength", 'H', edges);
+    if (!columns.ok()) return nullptr;
+
+    const char* data = batch.data;
+    Py_ssize_t n = 0, e = 0;
+    offsets[0] = 0;
+    for (Py_ssize_t i = 0; i < batch.count; data += batch.lengths[i], ++i) {
+        if (!payloads[i]) continue;
+        std::memcpy(&sender_ids[n], data, sizeof(uint16_t));
+        sent[n] = sendTimestamp(data, sizes[i], payloads[i]);
+        size_t edge_count = (payloads[i] - GRAPH_HEADER_SIZE) / sizeof(GraphEdge);
+        const char* edge = data + GRAPH_HEADER_SIZE;
+        for (size_t k = 0; k < edge_count; ++k, edge += sizeof(GraphEdge), ++e) {
+            std::memcpy(&sources[e], edge, sizeof(uint16_t));
+            std::memcpy(&targets[e], edge + 2, sizeof(uint16_t));
+            std::memcpy(&strengths[e], edge + 4, sizeof(uint16_t));
+        }
+        offsets[++n] = e;
+    }
+    return columns.result({{"malformed", malformed}, {"crc_failures", crc_failures}});
+}
+
+static PyObject* decodeEntityStates(PyObject*, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"data", "lengths", nullptr};
+    PyObject *data_object, *lengths_object;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO", (char**)keywords, &data_object, &lengths_object)) return nullptr;
+    Batch batch;
+    if (!batch.open(data_object, lengths_object)) return nullptr;
+
+    std::vector<EntityState> states(batch.count);
+    const char* data = batch.data;
+    Py_ssize_t count = 0;
+    for (Py_ssize_t i = 0; i < batch.count; data += batch.lengths[i], ++i) {
+        count += decodeEntityState(data, batch.lengths[i], states[count]);
+    }
+
+    Columns columns;
+    uint16_t* sites = columns.add<uint16_t>("site", 'H', count);
+    uint16_t* applications = columns.add<uint16_t>("application", 'H', count);
+    uint16_t* entities = columns.add<uint16_t>("entity", 'H', count);
+    double* xs = columns.add<double>("x", 'd', count);
+    double* ys = columns.add<double>("y", 'd', count);
+    double* zs = columns.add<double>("z", 'd', count);
+    float* psis = columns.add<float>("psi", 'f', count);
+    float* thetas = columns.add<float>("theta", 'f', count);
+    float* phis = columns.add<float>("phi", 'f', count);
+    if (!columns.ok()) return nullptr;
+    for (Py_ssize_t i = 0; i < count; ++i) {
+        const EntityState& state = states[i];
+        sites[i] = state.site;
+        applications[i] = state.application;
+        entities[i] = state.entity;
+        xs[i] = state.x;
+        ys[i] = state.y;
+        zs[i] = state.z;
+        psis[i] = state.psi;
+        thetas[i] = state.theta;
+        phis[i] = state.phi;
+    }
+    return columns.result({{"other", batch.count - count}});
+}
+
+static PyObject* receive(PyObject*, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"sock", "max_count", nullptr};
+    PyObject* sock;
+    Py_ssize_t max_count = RECEIVE_BATCH;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", (char**)keywords, &sock, &max_count)) return nullptr;
+    if (max_count < 1) {
+        PyErr_SetString(PyExc_ValueError, "max_count must be at least 1");
+        return nullptr;
+    }
+    int fd = PyObject_AsFileDescriptor(sock);
+    if (fd < 0) return nullptr;
+#ifdef __linux__
+    // every datagram gets a full slot, then the batch is packed back to back;
+    // the slots are kept per thread, as receiving threads run without the GIL
+    const size_t slot = RECEIVE_SLOT;
+    thread_local std::vector<char> slab;
+    thread_local std::vector<mmsghdr> messages;
+    thread_local std::vector<iovec> iovs;
+    if (slab.size() < max_count * slot) slab.resize(max_count * slot);
+    messages.resize(max_count);
+    iovs.resize(max_count);
+    for (Py_ssize_t i = 0; i < max_count; ++i) {
+        iovs[i] = {&slab[i * slot], slot};
+        messages[i] = {};
+        messages[i].msg_hdr.msg_iov = &iovs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int received;
+    Py_BEGIN_ALLOW_THREADS
+    received = recvmmsg(fd, messages.data(), max_count, MSG_WAITFORONE, nullptr);
+    Py_END_ALLOW_THREADS
+    if (received < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return PyErr_SetFromErrno(PyExc_OSError);
+        received = 0; // non-blocking socket with nothing queued
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < received; ++i) total += messages[i].msg_len;
+    Array* data = newArray('B', 1, total);
+    Array* lengths = newArray('I', 4, received);
+    if (!data || !lengths) {
+        Py_XDECREF(data);
+        Py_XDECREF(lengths);
+        return nullptr;
+    }
+    char* out = data->data;
+    for (int i = 0; i < received; ++i) {
+        std::memcpy(out, &slab[i * slot], messages[i].msg_len);
+        out += messages[i].msg_len;
+        items<uint32_t>(lengths)[i] = messages[i].msg_len;
+    }
+    return Py_BuildValue("(NN)", data, lengths);
+#else
+    PyErr_SetString(PyExc_NotImplementedError, "receive() needs recvmmsg (Linux)");
+    return nullptr;
+#endif
+}
+
+static PyMethodDef methods[] = {
+    {"receive", (PyCFunction)(void (*)(void))receive, METH_VARARGS | METH_KEYWORDS,
+     "receive(sock, max_count=1024) -> (data, lengths)\n\n"
+     "Up to max_count datagrams from one recvmmsg, waiting for the first on a\n"
+     "blocking socket. An empty batch when a non-blocking socket has none."},
+    {"decode_positions", (PyCFunction)(void (*)(void))decodePositions, METH_VARARGS | METH_KEYWORDS,
+     "decode_positions(data, lengths, crc=False) -> dict\n\n"
+     "Columns node_id, x, y and sent_ns (-1 without a timestamp trailer), plus\n"
+     "the malformed and crc_failures counts. With crc every datagram must end\n"
+     "in a valid CRC32C trailer (announcer --crc)."},
+    {"decode_graphs", (PyCFunction)(void (*)(void))decodeGraphs, METH_VARARGS | METH_KEYWORDS,
+     "decode_graphs(data, lengths, crc=False) -> dict\n\n"
+     "Columns sender_id, sent_ns and edge_offset per packet and source, target\n"
+     "and strength per edge: packet p owns edges [edge_offset[p], edge_offset[p + 1])."},
+    {"decode_entity_states", (PyCFunction)(void (*)(void))decodeEntityStates, METH_VARARGS | METH_KEYWORDS,
+     "decode_entity_states(data, lengths) -> dict\n\n"
+     "Columns site, application, entity, ECEF x, y, z and psi, theta, phi of\n"
+     "every DIS entity state PDU, plus the count of other PDUs."},
+    {nullptr, nullptr, 0, nullptr}};
+
+static PyModuleDef module = {PyModuleDef_HEAD_INIT, "node_decoder",
+                             "Batch decoding of node-announcer and DIS datagrams into buffer-protocol columns.", -1, methods,
+                             nullptr, nullptr, nullptr, nullptr};
+
+PyMODINIT_FUNC PyInit_node_decoder() {
+    array_buffer.bf_getbuffer = (getbufferproc)arrayGetBuffer;
+    array_sequence.sq_length = (lenfunc)arrayLength;
+    ArrayType.tp_name = "node_decoder.Array";
+    ArrayType.tp_basicsize = sizeof(Array);
+    ArrayType.tp_flags = Py_TPFLAGS_DEFAULT;
+    ArrayType.tp_doc = "A flat typed column; use numpy.asarray() or memoryview() on it.";
+    ArrayType.tp_dealloc = (destructor)arrayDealloc;
+    ArrayType.tp_repr = (reprfunc)arrayRepr;
+    ArrayType.tp_as_buffer = &array_buffer;
+    ArrayType.tp_as_sequence = &array_sequence;
+    if (PyType_Ready(&ArrayType) < 0) return nullptr;
+
+    PyObject* m = PyModule_Create(&module);
+    if (!m) return nullptr;
+    Py_INCREF(&ArrayType);
+    if (PyModule_AddObject(m, "Array", (PyObject*)&ArrayType) < 0) {
+        Py_DECREF(&ArrayType);
+        Py_DECREF(m);
+        return nullptr;
+    }
+    return m;
+}
@@ -22,6 +22,27 @@ f.edge_source = ProtoField.uint16("nodenet.edge.source", "Source Node", base.DEC
 f.edge_target = ProtoField.uint16("nodenet.edge.target", "Target Node", base.DEC)
 f.edge_strength = ProtoField.uint16("nodenet.edge.strength", "Strength", base.DEC)
 
+-- Optional trailers (node-announcer --timestamps, then --crc)
+f.send_time = ProtoField.int64("nodenet.send_time", "Send Timestamp (ns, announcer clock)", base.DEC)
+f.crc32c = ProtoField.uint32("nodenet.crc32c", "CRC32C (over everything before it)", base.HEX)
+
+-- Position packets are 10 bytes, plus 8 with a send time and 4 with a CRC
+local position_lengths = { [10] = true, [14] = true, [18] = true, [22] = true }
+
+-- Adds the trailers after the payload ending at `offset`; the bytes left over
+-- tell which are there: 8 for the send time, 4 for the CRC32C, 12 for both.
+local function dissect_trailers(buffer, offset, tree)
+    local left = buffer:len() - offset
+    if left == 8 or left == 12 then
+        tree:add_le(f.send_time, buffer(offset, 8))
+        offset = offset + 8
+        left = left - 8
+    end
+    if left == 4 then
+        tree:add_le(f.crc32c, buffer(offset, 4))
+    end
+end
+
 -- Create expert info fields for warnings/errors
 local ef = node_network_proto.experts
 ef.invalid_length = ProtoExpert.new("nodenet.invalid_length", "Invalid packet length", 
@@ -48,7 +69,7 @@ function node_network_proto.dissector(buffer, pinfo, tree)
     local is_position_port = (src_port == 12345 or dst_port == 12345)
     local is_graph_port = (src_port == 12346 or dst_port == 12346)
     
-    if is_position_port and length == 10 then
+    if is_position_port and position_lengths[length] then
         dissect_position_packet(buffer, pinfo, subtree)
     elseif is_graph_port and length >= 4 then
         dissect_graph_packet(buffer, pinfo, subtree)
@@ -83,6 +104,8 @@ function dissect_position_packet(buffer, pinfo, tree)
     -- Add summary
     local summary = tree:add(buffer(), string.format("Position Update: Node %d", node_id))
     summary:add(buffer(), string.format("Coordinates: (%.2f, %.2f)", x, y))
+
+    dissect_trailers(buffer, 10, tree)
 end
 
 -- Dissect graph packet
@@ -154,6 +177,10 @@ function dissect_graph_packet(buffer, pinfo, tree)
     -- Add summary
     local summary = tree:add(buffer(), string.format("Graph from Node %d", sender_id))
     summary:add(buffer(), string.format("Contains %d connections", edge_count))
+
+    if length > expected_length then
+        dissect_trailers(buffer, expected_length, tree)
+    end
 end
 
 -- Register the dissector for UDP ports
@@ -168,7 +195,7 @@ function node_network_proto.heuristic(buffer, pinfo, tree)
     local dst_port = pinfo.dst_port
     
     -- Check if this looks like our protocol
-    if (src_port == 12345 or dst_port == 12345) and length == 10 then
+    if (src_port == 12345 or dst_port == 12345) and position_lengths[length] then
         -- Looks like a position packet
         node_network_proto.dissector(buffer, pinfo, tree)
         return true